@@ -0,0 +1,416 @@
+#include "CandyTransform/Transform.h"
+#include "CandyTransform/NumberSearch.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include <boost/lexical_cast.hpp>
+
+/*
+        Reproducible workloads, built from the examples plus synthetic wide
+        and deep graphs
+
+                bench [filter] [--reps N]
+
+        For each workload reports results per second, nanoseconds and heap
+        allocations per hop (a call of a transform on a value), and the peak
+        RSS of the process so far. Run a single workload for its own peak
+ */
+
+namespace {
+        std::atomic<size_t> allocations{0};
+} // end namespace anon
+
+/*
+        Every replaceable form of new is counted, and every form of delete
+        frees what they allocate, so that each pair matches
+ */
+namespace {
+        void* Allocate(std::size_t n, std::size_t align = 0)noexcept{
+                ++allocations;
+                n = ( n ? n : 1 );
+                if( align <= alignof(std::max_align_t) )
+                        return std::malloc(n);
+                // aligned_alloc() wants a multiple of the alignment
+                return std::aligned_alloc(align, ( n + align - 1 ) / align * align);
+        }
+        void Free(void* ptr)noexcept{
+                std::free(ptr);
+        }
+        void* AllocateOrThrow(std::size_t n, std::size_t align = 0){
+                if( void* ptr = Allocate(n, align) )
+                        return ptr;
+                throw std::bad_alloc();
+        }
+} // end namespace anon
+
+void* operator new(std::size_t n){ return AllocateOrThrow(n); }
+void* operator new[](std::size_t n){ return AllocateOrThrow(n); }
+void* operator new(std::size_t n, std::align_val_t align){ return AllocateOrThrow(n, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t n, std::align_val_t align){ return AllocateOrThrow(n, static_cast<std::size_t>(align)); }
+void* operator new(std::size_t n, std::nothrow_t const&)noexcept{ return Allocate(n); }
+void* operator new[](std::size_t n, std::nothrow_t const&)noexcept{ return Allocate(n); }
+void* operator new(std::size_t n, std::align_val_t align, std::nothrow_t const&)noexcept{ return Allocate(n, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t n, std::align_val_t align, std::nothrow_t const&)noexcept{ return Allocate(n, static_cast<std::size_t>(align)); }
+
+void operator delete(void* ptr)noexcept{ Free(ptr); }
+void operator delete[](void* ptr)noexcept{ Free(ptr); }
+void operator delete(void* ptr, std::size_t)noexcept{ Free(ptr); }
+void operator delete[](void* ptr, std::size_t)noexcept{ Free(ptr); }
+void operator delete(void* ptr, std::align_val_t)noexcept{ Free(ptr); }
+void operator delete[](void* ptr, std::align_val_t)noexcept{ Free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t)noexcept{ Free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t)noexcept{ Free(ptr); }
+void operator delete(void* ptr, std::nothrow_t const&)noexcept{ Free(ptr); }
+void operator delete[](void* ptr, std::nothrow_t const&)noexcept{ Free(ptr); }
+void operator delete(void* ptr, std::align_val_t, std::nothrow_t const&)noexcept{ Free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, std::nothrow_t const&)noexcept{ Free(ptr); }
+
+namespace {
+        using namespace CandyTransform;
+
+        // example0
+        struct QuoteOne : Transform<std::string, std::string>{
+                QuoteOne(){
+                        SetName("QuoteOne");
+                        SetStateless();
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        auto copy = in;
+                        copy[0] = '_';
+                        ctrl->Emit(std::move(copy));
+                }
+        };
+        struct TimesTwo : Transform<std::string, std::string>{
+                TimesTwo(){
+                        SetName("TimesTwo");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        auto ret = in + in;
+                        bool one = ( ret.size() && ret[0] == '1' );
+                        ctrl->Emit(std::move(ret));
+                        auto dp = ctrl->DeclPath();
+                        if( one ){
+                                dp->Next(std::make_shared<QuoteOne>());
+                        }
+                }
+        };
+        struct ToString : Transform<int, std::string>{
+                ToString(){
+                        SetName("ToString");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        ctrl->Emit( boost::lexical_cast<std::string>(in) );
+                }
+        };
+        struct AllPerms : Transform<std::string, std::string>{
+                AllPerms(){
+                        SetName("AllPerms");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        auto s = in;
+                        std::sort(s.begin(), s.end());
+                        do{
+                                ctrl->Emit( s );
+                        }while(std::next_permutation(s.begin(), s.end()));
+                }
+        };
+        struct MaybeStop : Transform<std::string, std::string>{
+                MaybeStop(){
+                        SetName("MaybeStop");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        if( in[0] != '2' ){
+                                ctrl->Pass();
+                        }
+                }
+        };
+
+        // example1
+        struct PushFold : Transform<std::string, std::string>{
+                explicit PushFold(size_t depth)
+                        :depth_(depth)
+                {
+                        SetName("PushFold");
+                }
+                virtual bool Interchangeable(TransformBase const& that)const override{
+                        auto ptr = dynamic_cast<PushFold const*>(&that);
+                        return ptr && ptr->depth_ == depth_;
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        if( in.size() == depth_ ){
+                                ctrl->Pass();
+                                return;
+                        }
+                        ctrl->Emit( in + "p");
+                        ctrl->Emit( in + "f");
+                        ctrl->DeclPath()->Next(std::make_shared<PushFold>(depth_));
+                }
+        private:
+                size_t depth_;
+        };
+
+        // example2
+        struct Factorization{
+                std::vector<size_t> numbers;
+                std::vector<std::string> tokens;
+                size_t target;
+        };
+        struct F : Transform<Factorization, Factorization>{
+                F(){
+                        SetName("F");
+                        SetStateless();
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        if( in.numbers.size() == 1){
+                                if(in.numbers.back() == in.target ){
+                                        ctrl->Return(in.tokens.back());
+                                }
+                                return;
+                        }
+                        for(size_t i=0;i!=in.numbers.size();++i){
+                                for(size_t j=i+1;j!=in.numbers.size();++j){
+                                        EmitOp(ctrl, in, i, j, '+');
+                                        EmitOp(ctrl, in, i, j, '*');
+                                }
+                        }
+                        ctrl->DeclPath()->Next(std::make_shared<F>());
+                }
+        private:
+                static void EmitOp(TransformControl* ctrl, Factorization const& in, size_t i, size_t j, char op){
+                        Factorization next;
+                        next.target = in.target;
+                        for(size_t idx=0;idx!=in.numbers.size();++idx){
+                                if( idx == i || idx == j )
+                                        continue;
+                                next.numbers.push_back(in.numbers[idx]);
+                                next.tokens.push_back(in.tokens[idx]);
+                        }
+                        auto a = in.numbers[i];
+                        auto b = in.numbers[j];
+                        next.numbers.push_back( op == '+' ? a + b : a * b );
+                        next.tokens.push_back( "(" + in.tokens[i] + op + in.tokens[j] + ")" );
+                        ctrl->Emit(std::move(next));
+                }
+        };
+        Factorization MakeFactorization(std::vector<size_t> const& numbers, size_t target){
+                Factorization init;
+                init.numbers = numbers;
+                init.target = target;
+                for(auto _ : numbers){
+                        init.tokens.push_back(boost::lexical_cast<std::string>(_));
+                }
+                return init;
+        }
+
+        // synthetic
+        struct Inc : Transform<size_t, size_t>{
+                Inc(){
+                        SetName("Inc");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        ctrl->Emit(in + 1);
+                }
+        };
+        struct Fan : Transform<size_t, size_t>{
+                explicit Fan(size_t width)
+                        :width_(width)
+                {
+                        SetName("Fan");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        for(size_t idx=0;idx!=width_;++idx){
+                                ctrl->Emit(in + idx);
+                        }
+                }
+        private:
+                size_t width_;
+        };
+
+        struct Workload{
+                std::string name;
+                std::function<void(TransformContext&)> build;
+                // returns the number of results
+                std::function<size_t(TransformContext&)> run;
+        };
+
+        std::vector<Workload> Workloads(){
+                std::vector<Workload> w;
+
+                auto perms = [](TransformContext& ctx){
+                        ctx.Start()
+                            ->Next(std::make_shared<ToString>())
+                            ->Next(std::make_shared<AllPerms>())
+                            ->Next(std::make_shared<MaybeStop>())
+                            ->Next(std::make_shared<TimesTwo>());
+                };
+                for(int n : {2413, 241365, 2413657}){
+                        w.push_back(Workload{"perms/" + boost::lexical_cast<std::string>(n), perms, [n](TransformContext& ctx){
+                                return ctx.Execute<std::string>(n).size();
+                        }});
+                }
+                w.push_back(Workload{"perms-par/2413657", perms, [](TransformContext& ctx){
+                        return ctx.ExecuteParallel<std::string>(int{2413657}).size();
+                }});
+                // counted rather than collected
+                w.push_back(Workload{"perms-count/2413657", perms, [](TransformContext& ctx){
+                        return ctx.Reduce<std::string>(int{2413657}, CountReducer{});
+                }});
+
+                for(size_t depth : {8, 12, 16}){
+                        w.push_back(Workload{"pushfold/" + boost::lexical_cast<std::string>(depth), [depth](TransformContext& ctx){
+                                ctx.Start()->Next(std::make_shared<PushFold>(depth));
+                        }, [](TransformContext& ctx){
+                                return ctx.Execute<std::string>(std::string{}).size();
+                        }});
+                }
+
+                // many small executions against one graph
+                w.push_back(Workload{"many/1000xpushfold8", [](TransformContext& ctx){
+                        ctx.Start()->Next(std::make_shared<PushFold>(8));
+                }, [](TransformContext& ctx){
+                        std::vector<std::string> inputs(1000);
+                        size_t n = 0;
+                        for(auto const& r : ctx.ExecuteMany<std::string>(inputs)){
+                                n += r.size();
+                        }
+                        return n;
+                }});
+
+                auto countdown = [](TransformContext& ctx){
+                        ctx.Start()->Next(std::make_shared<F>());
+                };
+                w.push_back(Workload{"countdown/4", countdown, [](TransformContext& ctx){
+                        return ctx.Execute<std::string>(MakeFactorization({3,4,2,5}, 70)).size();
+                }});
+                w.push_back(Workload{"countdown/5", countdown, [](TransformContext& ctx){
+                        return ctx.Execute<std::string>(MakeFactorization({3,4,19,5,2}, 35)).size();
+                }});
+                w.push_back(Workload{"countdown/6", countdown, [](TransformContext& ctx){
+                        return ctx.Execute<std::string>(MakeFactorization({3,4,19,5,2,7}, 245)).size();
+                }});
+                w.push_back(Workload{"countdown-par/6", countdown, [](TransformContext& ctx){
+                        return ctx.ExecuteParallel<std::string>(MakeFactorization({3,4,19,5,2,7}, 245)).size();
+                }});
+
+                // as countdown, over blocks of fixed size states
+                w.push_back(Workload{"numbers/6", [](TransformContext& ctx){
+                        ctx.Start()->Next(std::make_shared<NumberSearch>());
+                }, [](TransformContext& ctx){
+                        return ctx.Execute<std::string>(NumberState({3,4,19,5,2,7}, 245)).size();
+                }});
+                w.push_back(Workload{"numbers-par/6", [](TransformContext& ctx){
+                        ctx.Start()
+                                ->Next(std::make_shared<NumberSplit>(2))
+                                ->Next(std::make_shared<NumberSearch>());
+                }, [](TransformContext& ctx){
+                        return ctx.ExecuteParallel<std::string>(NumberState({3,4,19,5,2,7}, 245)).size();
+                }});
+
+                // one node with many out edges
+                w.push_back(Workload{"wide/256x64", [](TransformContext& ctx){
+                        auto p = ctx.Start()->Next(std::make_shared<Fan>(256));
+                        for(size_t idx=0;idx!=64;++idx){
+                                p->Next(std::make_shared<Inc>());
+                        }
+                }, [](TransformContext& ctx){
+                        return ctx.Execute<size_t>(size_t{0}).size();
+                }});
+                // converging paths, sharing what follows the join
+                for(bool cached : {false, true}){
+                        w.push_back(Workload{std::string("diamond/256x64") + ( cached ? "-cached" : "" ), [cached](TransformContext& ctx){
+                                auto a = ctx.Start()->Next(std::make_shared<Fan>(256));
+                                auto b = ctx.Start()->Next(std::make_shared<Inc>())->Next(std::make_shared<Fan>(256));
+                                auto p = ctx.Join<size_t>({a, b});
+                                if( cached )
+                                        ctx.Cache<size_t>(p);
+                                for(size_t idx=0;idx!=64;++idx){
+                                        p = p->Next(std::make_shared<Inc>());
+                                }
+                        }, [](TransformContext& ctx){
+                                return ctx.Execute<size_t>(size_t{0}).size();
+                        }});
+                }
+                // long chain
+                w.push_back(Workload{"deep/256x64", [](TransformContext& ctx){
+                        auto p = ctx.Start()->Next(std::make_shared<Fan>(256));
+                        for(size_t idx=0;idx!=64;++idx){
+                                p = p->Next(std::make_shared<Inc>());
+                        }
+                }, [](TransformContext& ctx){
+                        return ctx.Execute<size_t>(size_t{0}).size();
+                }});
+                return w;
+        }
+
+        size_t PeakRssKb(){
+                struct rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+                return usage.ru_maxrss;
+        }
+} // end namespace anon
+
+int main(int argc, char** argv){
+        std::string filter;
+        size_t reps = 5;
+        for(int idx=1;idx<argc;++idx){
+                std::string arg = argv[idx];
+                if( arg == "--reps" && idx + 1 < argc ){
+                        reps = boost::lexical_cast<size_t>(argv[++idx]);
+                } else {
+                        filter = arg;
+                }
+        }
+
+        std::cout << std::left << std::setw(22) << "workload"
+                  << std::right
+                  << std::setw(10) << "results"
+                  << std::setw(12) << "hops"
+                  << std::setw(12) << "ms"
+                  << std::setw(14) << "results/s"
+                  << std::setw(10) << "ns/hop"
+                  << std::setw(12) << "allocs/hop"
+                  << std::setw(14) << "peak_rss_kb"
+                  << "\n";
+
+        for(auto const& w : Workloads()){
+                if( filter.size() && w.name.find(filter) == std::string::npos )
+                        continue;
+
+                TransformContext ctx;
+                w.build(ctx);
+
+                // count the hops once, then time without metrics
+                ctx.flags_ |= TransformContext::F_Metrics;
+                w.run(ctx);
+                size_t hops = 0;
+                for(auto const& t : ctx.Metrics().transforms){
+                        hops += t.items;
+                }
+                ctx.flags_ &= ~TransformContext::F_Metrics;
+
+                size_t results = 0;
+                size_t allocs_before = allocations;
+                auto start = std::chrono::steady_clock::now();
+                for(size_t rep=0;rep!=reps;++rep){
+                        results += w.run(ctx);
+                }
+                auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                size_t allocs = allocations - allocs_before;
+
+                double total_hops = double(hops) * reps;
+                std::cout << std::left << std::setw(22) << w.name
+                          << std::right << std::fixed << std::setprecision(1)
+                          << std::setw(10) << results / reps
+                          << std::setw(12) << hops
+                          << std::setw(12) << nanos / 1e6
+                          << std::setw(14) << std::setprecision(0) << results / ( nanos / 1e9 )
+                          << std::setw(10) << std::setprecision(1) << nanos / total_hops
+                          << std::setw(12) << std::setprecision(2) << allocs / total_hops
+                          << std::setw(14) << PeakRssKb()
+                          << "\n";
+        }
+}
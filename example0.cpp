@@ -8,11 +8,12 @@ int main(){
         struct QuoteOne : Transform<std::string, std::string>{
                 QuoteOne(){
                         SetName("QuoteOne");
+                        SetStateless();
                 }
                 virtual void Apply(TransformControl* ctrl, ParamType in)override{
                         auto copy = in;
                         copy[0] = '_';
-                        ctrl->Emit(copy);
+                        ctrl->Emit(std::move(copy));
                 }
         };
         struct TimesTwo : Transform<std::string, std::string>{
@@ -51,12 +52,20 @@ int main(){
         struct MaybeStop : Transform<std::string, std::string>{ 
                 MaybeStop(){
                         SetName("MaybeStop");
+                        SetBatchSize(16);
                 }
                 virtual void Apply(TransformControl* ctrl, ParamType in){
                         if( in[0] != '2' ){
                                 ctrl->Pass();
                         }
                 }
+                virtual void ApplyBatch(TransformControl* ctrl, Span<std::string> in)override{
+                        for(size_t idx=0;idx!=in.size();++idx){
+                                if( in[idx][0] != '2' ){
+                                        ctrl->PassArg(idx);
+                                }
+                        }
+                }
         };
         struct Print : Transform<std::string, std::string>{
                 Print(){
@@ -67,6 +76,7 @@ int main(){
                 }
         };
         TransformContext ctx;
+        ctx.flags_ |= TransformContext::F_Metrics;
         auto path = ctx.Start();
         path->Next(std::make_shared<ToString>())
             ->Next(std::make_shared<AllPerms>())
@@ -76,4 +86,40 @@ int main(){
         for(auto const& result : ctx.Execute<std::string>(int{241}) ){
                 std::cout << "result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
         }
+        ctx.Metrics().Print(std::cout);
+
+        /*
+         * Each item of a batch is routed on it's own, so the Return() of
+         * one item only replaces what that item emitted
+         */
+        struct Digits : Transform<int, int>{
+                Digits(){
+                        SetName("Digits");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        for(int idx=10;idx!=15;++idx){
+                                ctrl->Emit(idx);
+                        }
+                }
+        };
+        struct ReturnTwelve : Transform<int, int>{
+                ReturnTwelve(){
+                        SetName("ReturnTwelve");
+                        SetBatchSize(8);
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        if( in == 12 ){
+                                ctrl->Return(-in);
+                        } else {
+                                ctrl->Pass();
+                        }
+                }
+        };
+        TransformContext batched;
+        batched.Start()
+            ->Next(std::make_shared<Digits>())
+            ->Next(std::make_shared<ReturnTwelve>());
+        for(auto const& result : batched.Execute<int>(int{0}) ){
+                std::cout << "batched result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
+        }
 }
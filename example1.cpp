@@ -6,6 +6,10 @@
 int main(){
         using namespace CandyTransform;
         struct PushFold : Transform<std::string, std::string>{
+                PushFold(){
+                        SetName("PushFold");
+                        SetStateless();
+                }
                 virtual void Apply(TransformControl* ctrl, ParamType in)override{
                         if( in == "ff" ){
                                 ctrl->Pass();
@@ -26,4 +30,7 @@ int main(){
         for(auto const& result : ctx.Execute<std::string>(std::string{})){
                 std::cout << "result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
         }
+        // only expands as much of the tree as is needed for the first result
+        auto stream = ctx.Stream<std::string>(std::string{});
+        std::cout << "first => " << stream.Next().get() << "\n";
 }
@@ -139,6 +139,8 @@ namespace {
         struct F : Transform<Factorization, Factorization>{
                 std::vector<std::shared_ptr<Operator> > ops_;
                 F(){
+                        SetName("F");
+                        SetStateless();
                         ops_.push_back(std::make_shared<AddOperator>());
                         ops_.push_back(std::make_shared<MulOperator>());
                 }
@@ -160,6 +162,52 @@ namespace {
                         ctrl->DeclPath()->Next(std::make_shared<F>());
                 }
         };
+
+        /*
+           Nearest to the target, pruning partial factorizations which can't
+           get nearer than the nearest so far
+         */
+        struct Nearest : Transform<Factorization, Factorization>{
+                std::vector<std::shared_ptr<Operator> > ops_;
+                Nearest(){
+                        SetName("Nearest");
+                        SetStateless();
+                        ops_.push_back(std::make_shared<AddOperator>());
+                        ops_.push_back(std::make_shared<MulOperator>());
+                }
+                static double Distance(size_t value, size_t target){
+                        return value > target ? value - target : target - value;
+                }
+                /*
+                   For positive numbers, + and * never give less than the
+                   largest number, nor more than the product with 1's taken
+                   as 2's
+                 */
+                static double Bound(Factorization const& f){
+                        size_t lo = *std::max_element(f.numbers.begin(), f.numbers.end());
+                        size_t hi = 1;
+                        for(auto _ : f.numbers){
+                                hi *= std::max<size_t>(_, 2);
+                        }
+                        if( lo > f.target )
+                                return Distance(lo, f.target);
+                        if( hi < f.target )
+                                return Distance(hi, f.target);
+                        return 0;
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        if( in.numbers.size() == 1){
+                                if( ctrl->Publish(Distance(in.numbers.back(), in.target)) ){
+                                        ctrl->Return(in.tokens.back() + " = " + boost::lexical_cast<std::string>(in.numbers.back()));
+                                }
+                                return;
+                        }
+                        for(auto op : ops_ ){
+                                op->Emit( [&](auto&& f){ ctrl->EmitBounded(f, Bound(f)); }, in);
+                        }
+                        ctrl->DeclPath()->Next(std::make_shared<Nearest>());
+                }
+        };
 } // end namespace anon
 
 int main(){
@@ -210,4 +258,34 @@ int main(){
         for(auto const& result : ctx.Execute<std::string>(init) ){
                 std::cout << "result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
         }
+
+        /*
+           The operators reach the same multiset of numbers in many orders,
+           so only expand each multiset once
+         */
+        ctx.Dedupe<Factorization>([](Factorization const& f){
+                auto key = f.numbers;
+                std::sort(key.begin(), key.end());
+                return key;
+        });
+        for(auto const& result : ctx.Execute<std::string>(init) ){
+                std::cout << "deduped result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
+        }
+
+        /*
+           Branch and bound, each result is nearer than the last
+         */
+        TransformContext nearest;
+        nearest.flags_ |= TransformContext::F_Metrics;
+        nearest.Start()->Next(std::make_shared<Nearest>());
+        init.numbers = std::vector<size_t>{3,4,19,5,2};
+        init.tokens.clear();
+        for(auto _ : init.numbers ){
+                init.tokens.push_back(boost::lexical_cast<std::string>(_));
+        }
+        init.target = 1001;
+        for(auto const& result : nearest.Execute<std::string>(init) ){
+                std::cout << "nearer result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
+        }
+        std::cout << "pruned => " << nearest.Metrics().pruned << "\n"; // __CandyPrint__(cxx-print-scalar,nearest.Metrics().pruned)
 }
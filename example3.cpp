@@ -0,0 +1,77 @@
+#include "CandyTransform/Pipeline.h"
+#include <iostream>
+#include <string>
+#include <boost/lexical_cast.hpp>
+
+/*
+        example0, but with the linear part of the path composed at
+        compile time
+ */
+namespace {
+        using namespace CandyTransform;
+
+        struct ToString : Stage<int, std::string>{
+                template<class C>
+                void operator()(C&& c, int in)const{
+                        c( boost::lexical_cast<std::string>(in) );
+                }
+        };
+        struct AllPerms : Stage<std::string, std::string>{
+                template<class C>
+                void operator()(C&& c, std::string s)const{
+                        std::sort(s.begin(), s.end());
+                        do{
+                                c( s );
+                        }while(std::next_permutation(s.begin(), s.end()));
+                }
+        };
+        struct MaybeStop : Stage<std::string, std::string>{
+                template<class C>
+                void operator()(C&& c, std::string const& in)const{
+                        if( in[0] != '2' ){
+                                c(in);
+                        }
+                }
+        };
+        struct QuoteOne : Transform<std::string, std::string>{
+                QuoteOne(){
+                        SetName("QuoteOne");
+                        SetStateless();
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        auto copy = in;
+                        copy[0] = '_';
+                        ctrl->Emit(std::move(copy));
+                }
+        };
+        struct TimesTwo : Transform<std::string, std::string>{
+                TimesTwo(){
+                        SetName("TimesTwo");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        auto ret = in + in;
+                        ctrl->Emit(ret);
+                        auto dp = ctrl->DeclPath();
+                        if( ret.size() && ret[0] == '1' ){
+                                dp->Next(std::make_shared<QuoteOne>());
+                        }
+                }
+        };
+} // end namespace anon
+
+int main(){
+        auto p = Start<int>() | ToString{} | AllPerms{} | MaybeStop{};
+
+        for(auto const& result : p.Execute(241) ){
+                std::cout << "static => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
+        }
+
+        TransformContext ctx;
+        ctx.Start()
+            ->Next(p.AsTransform())
+            ->Next(std::make_shared<TimesTwo>())
+        ;
+        for(auto const& result : ctx.Execute<std::string>(int{241}) ){
+                std::cout << "result => " << result << "\n"; // __CandyPrint__(cxx-print-scalar,result)
+        }
+}
@@ -0,0 +1,68 @@
+#include "CandyTransform/Async.h"
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+/*
+        Anagrams of a word, looked up in a dictionary of one file per word.
+        The lookups are read on a pool, while the permutations go on being
+        expanded
+ */
+namespace {
+        using namespace CandyTransform;
+
+        struct AllPerms : Transform<std::string, std::string>{
+                AllPerms(){
+                        SetName("AllPerms");
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        auto s = in;
+                        std::sort(s.begin(), s.end());
+                        do{
+                                ctrl->Emit( s );
+                        }while(std::next_permutation(s.begin(), s.end()));
+                }
+        };
+        struct Lookup : AsyncTransform<std::string, std::string>{
+                Lookup(std::shared_ptr<AsyncPool> pool, std::filesystem::path dir)
+                        :pool_(pool),
+                        dir_(dir)
+                {
+                        SetName("Lookup");
+                }
+                virtual AsyncTask ApplyAsync(std::shared_ptr<TransformControl> ctrl, std::string in)override{
+                        auto path = dir_ / in;
+                        if( ! std::filesystem::exists(path) )
+                                co_return;
+                        auto meaning = co_await ReadFile(*pool_, path.string());
+                        ctrl->Emit( in + " => " + meaning );
+                }
+        private:
+                std::shared_ptr<AsyncPool> pool_;
+                std::filesystem::path dir_;
+        };
+} // end namespace anon
+
+int main(){
+        auto dir = std::filesystem::temp_directory_path() / "CandyTransform-example4";
+        std::filesystem::create_directories(dir);
+        std::ofstream(dir / "act") << "a thing done";
+        std::ofstream(dir / "cat") << "a small animal";
+        std::ofstream(dir / "tac") << "a horse shoe nail";
+
+        auto pool = std::make_shared<AsyncPool>(2);
+
+        TransformContext ctx;
+        ctx.Start()
+            ->Next(std::make_shared<AllPerms>())
+            ->Next(std::make_shared<Lookup>(pool, dir));
+
+        auto result = ctx.Execute<std::string>(std::string{"cat"});
+        std::sort(result.begin(), result.end());
+        for(auto const& _ : result ){
+                std::cout << "result => " << _ << "\n"; // __CandyPrint__(cxx-print-scalar,_)
+        }
+
+        std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,219 @@
+#ifndef CANDY_TRANSFORM_ASYNC_H
+#define CANDY_TRANSFORM_ASYNC_H
+
+#include "CandyTransform/Transform.h"
+
+/*
+ * Coroutine transforms, only with C++20 coroutines
+ */
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <condition_variable>
+#include <optional>
+
+namespace CandyTransform{
+
+        /*
+         * Kept alive by each of it's calls which is still running, as they
+         * can outlive the execution, see TransformControl::Defer()
+         */
+        struct AsyncTransformBase : std::enable_shared_from_this<AsyncTransformBase>{
+                virtual ~AsyncTransformBase()=default;
+        };
+
+        /*
+         * Return type of AsyncTransform::ApplyAsync(). The coroutine is
+         * started straight away, and destroys itself once it's run to
+         * completion, which releases the deferred control. An exception
+         * escaping it is logged as an error of the call
+         */
+        struct AsyncTask{
+                struct promise_type{
+                        promise_type()=default;
+                        // ApplyAsync(ctrl, in), so errors can be logged
+                        template<class Self, class... Rest>
+                        promise_type(Self& self, std::shared_ptr<TransformControl> const& ctrl, Rest&...)
+                                :ctrl_(ctrl),
+                                self_(KeepAlive(self))
+                        {}
+                        AsyncTask get_return_object(){ return AsyncTask{}; }
+                        std::suspend_never initial_suspend()noexcept{ return {}; }
+                        std::suspend_never final_suspend()noexcept{ return {}; }
+                        void return_void(){}
+                        void unhandled_exception(){
+                                if( ! ctrl_ )
+                                        std::terminate();
+                                try{
+                                        throw;
+                                } catch(std::exception const& e){
+                                        ctrl_->Error(e.what());
+                                } catch(...){
+                                        ctrl_->Error("unknown exception");
+                                }
+                        }
+                private:
+                        template<class Self>
+                        static std::shared_ptr<void const> KeepAlive(Self& self){
+                                if constexpr( std::is_base_of<AsyncTransformBase, Self>::value ){
+                                        return self.AsyncTransformBase::weak_from_this().lock();
+                                } else {
+                                        return nullptr;
+                                }
+                        }
+
+                        std::shared_ptr<TransformControl> ctrl_;
+                        std::shared_ptr<void const> self_;
+                };
+        };
+
+        /*
+         * Transform which can suspend, ie on I/O, without blocking the
+         * executor. Each call is deferred, so the executor goes on
+         * expanding the rest of the frontier while calls are suspended,
+         * and what a call emits is routed once it completes
+         *
+         *     struct Lookup : AsyncTransform<std::string, std::string>{
+         *             explicit Lookup(std::shared_ptr<AsyncPool> pool):pool_(pool){
+         *                     SetName("Lookup");
+         *             }
+         *             virtual AsyncTask ApplyAsync(std::shared_ptr<TransformControl> ctrl, std::string in)override{
+         *                     auto text = co_await ReadFile(*pool_, in);
+         *                     ctrl->Emit(text);
+         *             }
+         *             std::shared_ptr<AsyncPool> pool_;
+         *     };
+         *
+         * The argument is moved into the coroutine, so ctrl->Pass() isn't
+         * available, Emit() it instead. A call still running once it's
+         * execution has ended keeps the transform alive until it's done
+         */
+        template<class In_, class Out_>
+        struct AsyncTransform : Transform<In_, Out_>, AsyncTransformBase{
+                using ParamType = typename Transform<In_, Out_>::ParamType;
+                virtual AsyncTask ApplyAsync(std::shared_ptr<TransformControl> ctrl, In_ in)=0;
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        this->ApplyAsync(ctrl->Defer(), std::move(in));
+                }
+        };
+
+        /*
+         * Threads which coroutines are resumed on once the work they're
+         * waiting on is done. The queued work is finished before the pool is
+         * destroyed. It can be destroyed from one of it's threads, ie by a
+         * call which outlived it's execution dropping the transform, so the
+         * threads share the queue rather than referencing the pool
+         */
+        struct AsyncPool{
+                explicit AsyncPool(size_t threads = 4)
+                        :state_(std::make_shared<State>())
+                {
+                        for(size_t idx=0;idx!=std::max<size_t>(1, threads);++idx){
+                                threads_.emplace_back([state = state_](){ Run(*state); });
+                        }
+                }
+                ~AsyncPool(){
+                        {
+                                std::lock_guard<std::mutex> lock(state_->mtx);
+                                state_->stop = true;
+                        }
+                        state_->cv.notify_all();
+                        for(auto& t : threads_){
+                                if( t.get_id() == std::this_thread::get_id() ){
+                                        t.detach();
+                                } else {
+                                        t.join();
+                                }
+                        }
+                }
+                AsyncPool(AsyncPool const&)=delete;
+                AsyncPool& operator=(AsyncPool const&)=delete;
+
+                void Post(std::function<void()> work){
+                        {
+                                std::lock_guard<std::mutex> lock(state_->mtx);
+                                state_->work.push_back(std::move(work));
+                        }
+                        state_->cv.notify_one();
+                }
+
+                /*
+                 * Awaitable running f on the pool, the result of f is the
+                 * result of the co_await, and the coroutine continues on the
+                 * pool thread
+                 *
+                 *     auto n = co_await pool.Await([](){ return Slow(); });
+                 */
+                template<class F>
+                auto Await(F f){
+                        using R = std::invoke_result_t<F&>;
+                        static_assert( ! std::is_void<R>::value, "f must return a value" );
+                        struct Awaiter{
+                                bool await_ready()const noexcept{ return false; }
+                                void await_suspend(std::coroutine_handle<> h){
+                                        pool->Post([this, h](){
+                                                try{
+                                                        value.emplace(f());
+                                                } catch(...){
+                                                        err = std::current_exception();
+                                                }
+                                                h.resume();
+                                        });
+                                }
+                                R await_resume(){
+                                        if( err )
+                                                std::rethrow_exception(err);
+                                        return std::move(*value);
+                                }
+                                AsyncPool* pool;
+                                F f;
+                                std::optional<R> value;
+                                std::exception_ptr err;
+                        };
+                        return Awaiter{this, std::move(f), std::nullopt, nullptr};
+                }
+        private:
+                struct State{
+                        std::mutex mtx;
+                        std::condition_variable cv;
+                        std::deque<std::function<void()> > work;
+                        bool stop{false};
+                };
+                static void Run(State& state){
+                        for(;;){
+                                std::function<void()> work;
+                                {
+                                        std::unique_lock<std::mutex> lock(state.mtx);
+                                        state.cv.wait(lock, [&state](){ return state.stop || state.work.size(); });
+                                        if( state.work.empty() )
+                                                return;
+                                        work = std::move(state.work.front());
+                                        state.work.pop_front();
+                                }
+                                work();
+                        }
+                }
+                std::shared_ptr<State> state_;
+                std::vector<std::thread> threads_;
+        };
+
+        /*
+         * Contents of the file at path, read on the pool. Throws when it
+         * can't be read
+         */
+        inline auto ReadFile(AsyncPool& pool, std::string path){
+                return pool.Await([path = std::move(path)](){
+                        std::ifstream ifs(path, std::ios::binary);
+                        if( ! ifs )
+                                BOOST_THROW_EXCEPTION(std::runtime_error("unable to read " + path));
+                        std::stringstream sstr;
+                        sstr << ifs.rdbuf();
+                        return sstr.str();
+                });
+        }
+
+} // CandyTransform
+
+#endif // defined(__cpp_impl_coroutine)
+
+#endif // CANDY_TRANSFORM_ASYNC_H
@@ -0,0 +1,194 @@
+#ifndef CANDY_TRANSFORM_MEMORY_H
+#define CANDY_TRANSFORM_MEMORY_H
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+
+#include <boost/throw_exception.hpp>
+
+namespace CandyTransform{
+
+        /*
+         * What the memory of an execution is held by
+         */
+        enum MemoryCategory{
+                // values waiting in the frontier, not those spilled
+                MC_Frontier,
+                // values emitted by a call which haven't been routed yet
+                MC_Emitted,
+                // continuations declared with DeclPath()
+                MC_Graph,
+                // results held by the execution
+                MC_Results,
+                // transposition tables of Dedupe() and Cache()
+                MC_Tables,
+                // values folded so far by JP_Reduce joins
+                MC_Joins,
+        };
+        enum{ MemoryCategories = 6 };
+
+        /*
+         * Bytes of a value, including what it owns on the heap. Values of
+         * other types are counted as sizeof(T), pass a size function for
+         * those which own memory
+         */
+        template<class T, class = void>
+        struct DefaultValueSize{
+                static size_t Of(T const&){ return sizeof(T); }
+        };
+        template<>
+        struct DefaultValueSize<std::string>{
+                static size_t Of(std::string const& value){
+                        // short strings are kept inline
+                        static const size_t inline_capacity = std::string().capacity();
+                        return sizeof(std::string) + ( value.capacity() > inline_capacity ? value.capacity() + 1 : 0 );
+                }
+        };
+        template<class T>
+        struct DefaultValueSize<std::vector<T> >{
+                static size_t Of(std::vector<T> const& value){
+                        size_t bytes = sizeof(std::vector<T>) + value.capacity() * sizeof(T);
+                        if( ! std::is_trivially_copyable<T>::value ){
+                                for(auto const& _ : value){
+                                        bytes += DefaultValueSize<T>::Of(_) - sizeof(T);
+                                }
+                        }
+                        return bytes;
+                }
+        };
+
+        struct MemoryUsage{
+                std::array<uint64_t, MemoryCategories> current{};
+                std::array<uint64_t, MemoryCategories> peak{};
+                uint64_t total{0};
+                // of the total, not the sum of the peaks
+                uint64_t peak_total{0};
+                // 0 for none
+                uint64_t budget{0};
+
+                static char const* Name(size_t category){
+                        static char const* names[] = {"frontier", "emitted", "graph", "results", "tables", "joins"};
+                        return names[category];
+                }
+                /*
+                 * Largest of each peak
+                 */
+                void Merge(MemoryUsage const& that){
+                        for(size_t idx=0;idx!=MemoryCategories;++idx){
+                                peak[idx] = std::max(peak[idx], that.peak[idx]);
+                        }
+                        peak_total = std::max(peak_total, that.peak_total);
+                        budget = std::max(budget, that.budget);
+                }
+                void Print(std::ostream& ostr)const{
+                        ostr << "total = " << total << ", peak_total = " << peak_total;
+                        if( budget )
+                                ostr << ", budget = " << budget;
+                        ostr << "\n";
+                        for(size_t idx=0;idx!=MemoryCategories;++idx){
+                                ostr << "{category=" << Name(idx)
+                                     << ", current=" << current[idx]
+                                     << ", peak=" << peak[idx]
+                                     << "}\n";
+                        }
+                }
+        };
+
+        /*
+         * Thrown by an execution once it's memory is over the budget, see
+         * TransformContext::SetMemoryBudget()
+         */
+        struct MemoryBudgetExceeded : std::runtime_error{
+                explicit MemoryBudgetExceeded(MemoryUsage const& usage_)
+                        :std::runtime_error(Describe(usage_)),
+                        usage(usage_)
+                {}
+                MemoryUsage usage;
+        private:
+                static std::string Describe(MemoryUsage const& usage){
+                        std::stringstream sstr;
+                        sstr << "execution is using " << usage.total << " bytes, over the budget of " << usage.budget << " (";
+                        for(size_t idx=0;idx!=MemoryCategories;++idx){
+                                sstr << ( idx ? ", " : "" ) << MemoryUsage::Name(idx) << "=" << usage.current[idx];
+                        }
+                        sstr << ")";
+                        return sstr.str();
+                }
+        };
+
+        /*
+         * Bytes of one execution by category. Updated by every worker of
+         * the execution, so the counters are atomic. done(usage) is called
+         * once the execution is over
+         */
+        struct MemoryAccount{
+                explicit MemoryAccount(size_t budget, std::function<void(MemoryUsage const&)> done = {})
+                        :budget_(budget),
+                        done_(std::move(done))
+                {}
+                ~MemoryAccount(){
+                        if( done_ )
+                                done_(Usage());
+                }
+                MemoryAccount(MemoryAccount const&)=delete;
+                MemoryAccount& operator=(MemoryAccount const&)=delete;
+
+                void Add(MemoryCategory category, uint64_t bytes){
+                        if( bytes == 0 )
+                                return;
+                        Max(peak_[category], current_[category].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+                        Max(peak_total_, total_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+                }
+                void Sub(MemoryCategory category, uint64_t bytes){
+                        if( bytes == 0 )
+                                return;
+                        current_[category].fetch_sub(bytes, std::memory_order_relaxed);
+                        total_.fetch_sub(bytes, std::memory_order_relaxed);
+                }
+                /*
+                 * Throws MemoryBudgetExceeded when over the budget
+                 */
+                void Check()const{
+                        if( budget_ && total_.load(std::memory_order_relaxed) > budget_ )
+                                BOOST_THROW_EXCEPTION(MemoryBudgetExceeded(Usage()));
+                }
+                MemoryUsage Usage()const{
+                        MemoryUsage usage;
+                        for(size_t idx=0;idx!=MemoryCategories;++idx){
+                                usage.current[idx] = current_[idx].load(std::memory_order_relaxed);
+                                usage.peak[idx] = peak_[idx].load(std::memory_order_relaxed);
+                        }
+                        usage.total = total_.load(std::memory_order_relaxed);
+                        usage.peak_total = peak_total_.load(std::memory_order_relaxed);
+                        usage.budget = budget_;
+                        return usage;
+                }
+        private:
+                static void Max(std::atomic<uint64_t>& peak, uint64_t value){
+                        auto prev = peak.load(std::memory_order_relaxed);
+                        for(;value > prev;){
+                                if( peak.compare_exchange_weak(prev, value, std::memory_order_relaxed) )
+                                        break;
+                        }
+                }
+
+                size_t budget_;
+                std::function<void(MemoryUsage const&)> done_;
+                std::array<std::atomic<uint64_t>, MemoryCategories> current_{};
+                std::array<std::atomic<uint64_t>, MemoryCategories> peak_{};
+                std::atomic<uint64_t> total_{0};
+                std::atomic<uint64_t> peak_total_{0};
+        };
+
+} // CandyTransform
+
+#endif // CANDY_TRANSFORM_MEMORY_H
@@ -0,0 +1,266 @@
+#ifndef CANDY_TRANSFORM_METRICS_H
+#define CANDY_TRANSFORM_METRICS_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace CandyTransform{
+
+        /*
+         * Counter with a single writer, so updates are a plain load and
+         * store, but can be read from any thread
+         */
+        struct Counter{
+                void Add(uint64_t n){
+                        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+                }
+                void Max(uint64_t n){
+                        if( n > value_.load(std::memory_order_relaxed) )
+                                value_.store(n, std::memory_order_relaxed);
+                }
+                uint64_t Get()const{ return value_.load(std::memory_order_relaxed); }
+        private:
+                std::atomic<uint64_t> value_{0};
+        };
+
+        /*
+         * Latency of ApplyImpl, bucket i counts calls taking [2^(i-1), 2^i)
+         * nanoseconds
+         */
+        enum{ LatencyBuckets = 32 };
+
+        inline size_t LatencyBucket(uint64_t nanos){
+                size_t bucket = 0;
+                for(;nanos && bucket + 1 != LatencyBuckets;nanos >>= 1){
+                        ++bucket;
+                }
+                return bucket;
+        }
+
+        struct TransformCounters{
+                explicit TransformCounters(std::string const& name_)
+                        :name(name_)
+                {}
+                std::string name;
+                // calls to ApplyImpl or ApplyBatchImpl
+                Counter calls;
+                // values passed in, more than calls when batched
+                Counter items;
+                Counter emits;
+                Counter errors;
+                Counter returns;
+                Counter nanos;
+                std::array<Counter, LatencyBuckets> latency;
+        };
+
+        /*
+         * Counters of one thread, keyed by transform. Only the owning thread
+         * adds transforms, so it looks up without the lock
+         */
+        struct MetricsShard{
+                /*
+                 * Of a transform which lives as long as the shard, ie one
+                 * of the graph of the context
+                 */
+                TransformCounters& Get(void const* transform, std::string const& name){
+                        auto iter = counters_.find(transform);
+                        if( iter != counters_.end() )
+                                return *iter->second;
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        auto& ptr = counters_[transform];
+                        ptr.reset(new TransformCounters(name));
+                        return *ptr;
+                }
+                /*
+                 * Of transforms which don't, ie continuations declared during
+                 * an execution, which are freed with it, so the address
+                 * could be reused by another transform
+                 */
+                TransformCounters& GetByName(std::string const& name){
+                        auto iter = by_name_.find(name);
+                        if( iter != by_name_.end() )
+                                return *iter->second;
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        auto& ptr = by_name_[name];
+                        ptr.reset(new TransformCounters(name));
+                        return *ptr;
+                }
+                template<class F>
+                void ForEach(F&& f){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        for(auto const& p : counters_){
+                                f(*p.second);
+                        }
+                        for(auto const& p : by_name_){
+                                f(*p.second);
+                        }
+                }
+                Counter peak_frontier;
+                // items dropped by branch and bound
+                Counter pruned;
+        private:
+                std::mutex mtx_;
+                std::unordered_map<void const*, std::unique_ptr<TransformCounters> > counters_;
+                std::unordered_map<std::string, std::unique_ptr<TransformCounters> > by_name_;
+        };
+
+        struct TransformStats{
+                std::string name;
+                uint64_t calls{0};
+                uint64_t items{0};
+                uint64_t emits{0};
+                uint64_t errors{0};
+                uint64_t returns{0};
+                uint64_t nanos{0};
+                std::array<uint64_t, LatencyBuckets> latency{};
+
+                // values emitted per value in, ie the real branching factor
+                double FanOut()const{ return items ? double(emits) / items : 0.0; }
+                double MeanNanos()const{ return calls ? double(nanos) / calls : 0.0; }
+        };
+
+        struct MetricsSnapshot{
+                // most time first
+                std::vector<TransformStats> transforms;
+                uint64_t peak_frontier{0};
+                uint64_t pruned{0};
+
+                void Print(std::ostream& ostr)const{
+                        ostr << "peak_frontier = " << peak_frontier << "\n";
+                        if( pruned )
+                                ostr << "pruned = " << pruned << "\n";
+                        for(auto const& t : transforms){
+                                ostr << "{name=" << t.name
+                                     << ", calls=" << t.calls
+                                     << ", items=" << t.items
+                                     << ", emits=" << t.emits
+                                     << ", errors=" << t.errors
+                                     << ", returns=" << t.returns
+                                     << ", nanos=" << t.nanos
+                                     << ", fan_out=" << t.FanOut()
+                                     << ", mean_nanos=" << t.MeanNanos()
+                                     << "}\n";
+                        }
+                }
+                void PrintJson(std::ostream& ostr)const{
+                        ostr << "{\"peak_frontier\":" << peak_frontier << ",\"pruned\":" << pruned << ",\"transforms\":[";
+                        const char* comma = "";
+                        for(auto const& t : transforms){
+                                ostr << comma << "{\"name\":";
+                                PrintJsonString(ostr, t.name);
+                                ostr << ",\"calls\":" << t.calls
+                                     << ",\"items\":" << t.items
+                                     << ",\"emits\":" << t.emits
+                                     << ",\"errors\":" << t.errors
+                                     << ",\"returns\":" << t.returns
+                                     << ",\"nanos\":" << t.nanos
+                                     << ",\"latency_log2_nanos\":[";
+                                for(size_t idx=0;idx!=t.latency.size();++idx){
+                                        ostr << ( idx ? "," : "" ) << t.latency[idx];
+                                }
+                                ostr << "]}";
+                                comma = ",";
+                        }
+                        ostr << "]}";
+                }
+                static void PrintJsonString(std::ostream& ostr, std::string const& s){
+                        ostr << '"';
+                        for(char c : s){
+                                switch(c){
+                                case '"':  ostr << "\\\""; break;
+                                case '\\': ostr << "\\\\"; break;
+                                case '\n': ostr << "\\n"; break;
+                                case '\t': ostr << "\\t"; break;
+                                default:
+                                        if( static_cast<unsigned char>(c) < 0x20 ){
+                                                const char* hex = "0123456789abcdef";
+                                                ostr << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                                        } else {
+                                                ostr << c;
+                                        }
+                                }
+                        }
+                        ostr << '"';
+                }
+        };
+
+        /*
+         * All the shards of a context. A shard is held by one thread for an
+         * execution, then returned for reuse, and the counters are only
+         * summed when a snapshot is taken
+         */
+        struct TransformMetrics{
+                MetricsShard* Acquire(){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        if( free_.size() ){
+                                auto shard = free_.back();
+                                free_.pop_back();
+                                return shard;
+                        }
+                        shards_.emplace_back(new MetricsShard);
+                        return shards_.back().get();
+                }
+                void Release(MetricsShard* shard){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        free_.push_back(shard);
+                }
+                /*
+                 * Sums the shards by transform name
+                 */
+                MetricsSnapshot Snapshot(){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        MetricsSnapshot snapshot;
+                        std::unordered_map<std::string, size_t> index;
+                        for(auto const& shard : shards_){
+                                snapshot.peak_frontier = std::max(snapshot.peak_frontier, shard->peak_frontier.Get());
+                                snapshot.pruned += shard->pruned.Get();
+                                shard->ForEach([&](TransformCounters const& c){
+                                        auto iter = index.find(c.name);
+                                        if( iter == index.end() ){
+                                                iter = index.emplace(c.name, snapshot.transforms.size()).first;
+                                                snapshot.transforms.emplace_back();
+                                                snapshot.transforms.back().name = c.name;
+                                        }
+                                        auto& t = snapshot.transforms[iter->second];
+                                        t.calls   += c.calls.Get();
+                                        t.items   += c.items.Get();
+                                        t.emits   += c.emits.Get();
+                                        t.errors  += c.errors.Get();
+                                        t.returns += c.returns.Get();
+                                        t.nanos   += c.nanos.Get();
+                                        for(size_t idx=0;idx!=LatencyBuckets;++idx){
+                                                t.latency[idx] += c.latency[idx].Get();
+                                        }
+                                });
+                        }
+                        std::sort(snapshot.transforms.begin(), snapshot.transforms.end(), [](auto const& a, auto const& b){
+                                return a.nanos > b.nanos;
+                        });
+                        return snapshot;
+                }
+                /*
+                 * Must not be called during an execution
+                 */
+                void Reset(){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        free_.clear();
+                        shards_.clear();
+                }
+        private:
+                std::mutex mtx_;
+                std::vector<std::unique_ptr<MetricsShard> > shards_;
+                std::vector<MetricsShard*> free_;
+        };
+
+} // CandyTransform
+
+#endif // CANDY_TRANSFORM_METRICS_H
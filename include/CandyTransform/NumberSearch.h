@@ -0,0 +1,389 @@
+#ifndef CANDY_TRANSFORM_NUMBER_SEARCH_H
+#define CANDY_TRANSFORM_NUMBER_SEARCH_H
+
+#include "CandyTransform/Transform.h"
+
+/*
+ * Target number search, ie which ways of combining all of the numbers
+ * with the operators give the target, as example2 does with a
+ * Factorization per state. Here a state is a fixed size value with no
+ * allocations, and the expression of a state is only spelled out when it
+ * hits the target.
+ *
+ *     ctx.Start()
+ *         ->Next(std::make_shared<NumberSplit>(2))
+ *         ->Next(std::make_shared<NumberSearch>());
+ *     for(auto const& r : ctx.ExecuteParallel<std::string>(NumberState({3,4,2,5}, 70))){
+ *         ...
+ *     }
+ *
+ * NumberSplit expands the first few levels through the frontier, so that
+ * the executors have subtrees to spread between workers, and NumberSearch
+ * searches each subtree to the end itself, a level at a time over blocks
+ * of states.
+ *
+ * Numbers are unsigned 64 bit and wrap on overflow
+ */
+
+namespace CandyTransform{
+
+        enum NumberOp{
+                NO_Add = 1,
+                NO_Mul = 2,
+                // the larger less the smaller, when they differ
+                NO_Sub = 4,
+                // the larger over the smaller, when it divides exactly, and
+                // the smaller isn't 1
+                NO_Div = 8,
+        };
+
+        /*
+         * Numbers left to combine, with the leaves they were made from and
+         * the steps taken so far, so the expression can be rebuilt.
+         * Trivially copyable, so it can be spilled and checkpointed with
+         * the default serializer
+         */
+        struct NumberState{
+                enum{ MaxNumbers = 8 };
+
+                NumberState()=default;
+                NumberState(std::vector<uint64_t> const& numbers, uint64_t target_)
+                        :target(target_)
+                {
+                        if( numbers.empty() || numbers.size() > MaxNumbers )
+                                BOOST_THROW_EXCEPTION(std::invalid_argument("between 1 and " + std::to_string(int{MaxNumbers}) + " numbers"));
+                        size = leaf_count = static_cast<uint8_t>(numbers.size());
+                        std::copy(numbers.begin(), numbers.end(), this->numbers);
+                        std::copy(numbers.begin(), numbers.end(), leaves);
+                }
+
+                /*
+                 * Byte n-2 of the trace is the step which took n numbers to
+                 * n-1, the index of the left operand, the right one shifted
+                 * by 3, and the operator shifted by 6
+                 */
+                static uint8_t Step(size_t lhs, size_t rhs, size_t op){
+                        return static_cast<uint8_t>(lhs | ( rhs << 3 ) | ( op << 6 ));
+                }
+                /*
+                 * The expression of each number left
+                 */
+                static std::vector<std::string> Expressions(uint64_t const* leaves, size_t leaf_count, uint64_t trace, size_t size){
+                        static const char ops[] = {'+', '*', '-', '/'};
+                        std::vector<std::string> tokens;
+                        for(size_t idx=0;idx!=leaf_count;++idx){
+                                tokens.push_back(std::to_string(leaves[idx]));
+                        }
+                        for(size_t n=leaf_count;n > size && n >= 2;--n){
+                                auto code = static_cast<uint8_t>(trace >> ( 8 * ( n - 2 ) ));
+                                size_t lhs = code & 7;
+                                size_t rhs = ( code >> 3 ) & 7;
+                                auto expr = "(" + tokens[lhs] + ops[code >> 6] + tokens[rhs] + ")";
+                                tokens.erase(tokens.begin() + std::max(lhs, rhs));
+                                tokens.erase(tokens.begin() + std::min(lhs, rhs));
+                                tokens.push_back(std::move(expr));
+                        }
+                        return tokens;
+                }
+                std::vector<std::string> Expressions()const{
+                        return Expressions(leaves, leaf_count, trace, size);
+                }
+
+                uint64_t target{0};
+                uint64_t numbers[MaxNumbers]{};
+                uint64_t leaves[MaxNumbers]{};
+                uint64_t trace{0};
+                uint8_t size{0};
+                uint8_t leaf_count{0};
+        };
+
+        /*
+         * The operators, a value of op with the larger operand first, or
+         * false when it's not allowed
+         */
+        inline bool ApplyNumberOp(size_t op, uint64_t a, uint64_t b, uint64_t& value){
+                auto hi = std::max(a, b);
+                auto lo = std::min(a, b);
+                switch(op){
+                case 0: value = a + b; return true;
+                case 1: value = a * b; return true;
+                case 2: value = hi - lo; return hi != lo;
+                case 3: value = ( lo > 1 ? hi / lo : 0 ); return lo > 1 && hi % lo == 0;
+                }
+                return false;
+        }
+
+        /*
+         * Expands levels of the search, emitting the states levels steps
+         * down, or those which got to one number sooner
+         */
+        struct NumberSplit : Transform<NumberState, NumberState>{
+                explicit NumberSplit(size_t levels, unsigned ops = NO_Add | NO_Mul)
+                        :levels_(levels),
+                        ops_(ops)
+                {
+                        SetName("NumberSplit");
+                        SetStateless();
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        Split(ctrl, in, levels_);
+                }
+        private:
+                void Split(TransformControl* ctrl, NumberState const& s, size_t levels){
+                        if( levels == 0 || s.size == 1 ){
+                                ctrl->Emit(s);
+                                return;
+                        }
+                        for(size_t i=0;i!=s.size;++i){
+                                for(size_t j=i+1;j!=s.size;++j){
+                                        for(size_t op=0;op!=4;++op){
+                                                if( ! ( ops_ & ( 1u << op ) ) )
+                                                        continue;
+                                                uint64_t value;
+                                                if( ! ApplyNumberOp(op, s.numbers[i], s.numbers[j], value) )
+                                                        continue;
+                                                NumberState next = s;
+                                                size_t k = 0;
+                                                for(size_t c=0;c!=s.size;++c){
+                                                        if( c != i && c != j )
+                                                                next.numbers[k++] = s.numbers[c];
+                                                }
+                                                next.numbers[k] = value;
+                                                next.size = static_cast<uint8_t>(s.size - 1);
+                                                bool swap = op >= 2 && s.numbers[j] > s.numbers[i];
+                                                next.trace |= uint64_t{NumberState::Step(swap ? j : i, swap ? i : j, op)} << ( 8 * ( s.size - 2 ) );
+                                                Split(ctrl, next, levels - 1);
+                                        }
+                                }
+                        }
+                }
+                size_t levels_;
+                unsigned ops_;
+        };
+
+        /*
+         * Searches each state to the end, emitting the expression of each
+         * way of getting to the target. States are kept in a block per
+         * number of numbers left, as a column per number, so each
+         * operator is applied to a pair of columns of the block at once,
+         * in loops the compiler vectorises. A block is expanded into the
+         * next once it's full, so the memory is fixed, and the last level
+         * is only compared against the target
+         */
+        struct NumberSearch : Transform<NumberState, std::string>{
+                enum{ BlockSize = 256 };
+
+                explicit NumberSearch(unsigned ops = NO_Add | NO_Mul)
+                        :ops_(ops)
+                {
+                        SetName("NumberSearch");
+                        SetStateless();
+                        SetBatchSize(64);
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        Search(ctrl, &in, 1);
+                }
+                virtual void ApplyBatch(TransformControl* ctrl, Span<NumberState> in)override{
+                        Search(ctrl, in.data(), in.size());
+                }
+        private:
+                enum{ MaxNumbers = NumberState::MaxNumbers };
+                struct Block{
+                        size_t count{0};
+                        uint64_t num[MaxNumbers][BlockSize];
+                        uint64_t target[BlockSize];
+                        uint64_t trace[BlockSize];
+                        // index into Scratch::roots, for the leaves
+                        uint32_t root[BlockSize];
+                };
+                /*
+                 * Per thread, as the transform is shared by the workers
+                 */
+                struct Scratch{
+                        Block level[MaxNumbers + 1];
+                        std::vector<NumberState const*> roots;
+                        uint64_t value[BlockSize];
+                        uint8_t valid[BlockSize];
+                        uint8_t code[BlockSize];
+                };
+                static Scratch& ThreadScratch(){
+                        thread_local std::unique_ptr<Scratch> scratch(new Scratch);
+                        return *scratch;
+                }
+
+                void Search(TransformControl* ctrl, NumberState const* first, size_t n){
+                        auto& sc = ThreadScratch();
+                        sc.roots.clear();
+                        for(size_t idx=0;idx!=n;++idx){
+                                auto const& s = first[idx];
+                                if( s.size == 1 ){
+                                        if( s.numbers[0] == s.target )
+                                                ctrl->Emit(s.Expressions().front());
+                                        continue;
+                                }
+                                auto& b = sc.level[s.size];
+                                if( b.count == BlockSize )
+                                        Expand(ctrl, sc, s.size);
+                                for(size_t c=0;c!=s.size;++c){
+                                        b.num[c][b.count] = s.numbers[c];
+                                }
+                                b.target[b.count] = s.target;
+                                b.trace[b.count] = s.trace;
+                                b.root[b.count] = static_cast<uint32_t>(sc.roots.size());
+                                sc.roots.push_back(&s);
+                                ++b.count;
+                        }
+                        // a level only fills the levels below it
+                        for(size_t size=MaxNumbers;size>=2;--size){
+                                if( sc.level[size].count )
+                                        Expand(ctrl, sc, size);
+                        }
+                }
+
+                /*
+                 * Every child of every state of the block of size, into the
+                 * block below, which is expanded whenever it fills. Each
+                 * pair and operator makes a run of children, one for each
+                 * state
+                 */
+                void Expand(TransformControl* ctrl, Scratch& sc, size_t size){
+                        if( size == 2 ){
+                                Hits(ctrl, sc);
+                                return;
+                        }
+                        auto& in = sc.level[size];
+                        auto& out = sc.level[size-1];
+                        size_t count = in.count;
+                        auto shift = 8 * ( size - 2 );
+                        for(size_t i=0;i!=size;++i){
+                                for(size_t j=i+1;j!=size;++j){
+                                        for(size_t op=0;op!=4;++op){
+                                                if( ! ( ops_ & ( 1u << op ) ) )
+                                                        continue;
+                                                if( out.count + count > BlockSize )
+                                                        Expand(ctrl, sc, size - 1);
+                                                auto base = out.count;
+                                                uint64_t const* a = in.num[i];
+                                                uint64_t const* b = in.num[j];
+                                                uint64_t* value = out.num[size-2] + base;
+                                                auto forward = NumberState::Step(i, j, op);
+                                                auto reverse = NumberState::Step(j, i, op);
+                                                switch(op){
+                                                case 0:
+                                                        for(size_t s=0;s!=count;++s){
+                                                                value[s] = a[s] + b[s];
+                                                        }
+                                                        break;
+                                                case 1:
+                                                        for(size_t s=0;s!=count;++s){
+                                                                value[s] = a[s] * b[s];
+                                                        }
+                                                        break;
+                                                default:
+                                                        Checked(sc, op, a, b, count, forward, reverse);
+                                                        break;
+                                                }
+                                                size_t k = 0;
+                                                for(size_t c=0;c!=size;++c){
+                                                        if( c == i || c == j )
+                                                                continue;
+                                                        std::copy(in.num[c], in.num[c] + count, out.num[k] + base);
+                                                        ++k;
+                                                }
+                                                std::copy(in.target, in.target + count, out.target + base);
+                                                std::copy(in.root, in.root + count, out.root + base);
+                                                uint64_t* trace = out.trace + base;
+                                                if( op < 2 ){
+                                                        uint64_t step = uint64_t{forward} << shift;
+                                                        for(size_t s=0;s!=count;++s){
+                                                                trace[s] = in.trace[s] | step;
+                                                        }
+                                                        out.count += count;
+                                                        continue;
+                                                }
+                                                // keep the allowed ones
+                                                size_t w = 0;
+                                                for(size_t s=0;s!=count;++s){
+                                                        if( ! sc.valid[s] )
+                                                                continue;
+                                                        for(size_t c=0;c!=size-1;++c){
+                                                                out.num[c][base+w] = out.num[c][base+s];
+                                                        }
+                                                        value[w] = sc.value[s];
+                                                        out.target[base+w] = in.target[s];
+                                                        out.root[base+w] = in.root[s];
+                                                        trace[w] = in.trace[s] | ( uint64_t{sc.code[s]} << shift );
+                                                        ++w;
+                                                }
+                                                out.count += w;
+                                        }
+                                }
+                        }
+                        in.count = 0;
+                }
+                /*
+                 * The operators which aren't always allowed, into the
+                 * scratch columns
+                 */
+                static void Checked(Scratch& sc, size_t op, uint64_t const* a, uint64_t const* b, size_t count, uint8_t forward, uint8_t reverse){
+                        for(size_t s=0;s!=count;++s){
+                                auto hi = std::max(a[s], b[s]);
+                                auto lo = std::min(a[s], b[s]);
+                                sc.code[s] = ( b[s] > a[s] ? reverse : forward );
+                                if( op == 2 ){
+                                        sc.value[s] = hi - lo;
+                                        sc.valid[s] = hi != lo;
+                                } else {
+                                        sc.valid[s] = lo > 1 && hi % lo == 0;
+                                        sc.value[s] = ( sc.valid[s] ? hi / lo : 0 );
+                                }
+                        }
+                }
+                /*
+                 * The last step, only compared against the target, and only
+                 * the hits are spelled out
+                 */
+                void Hits(TransformControl* ctrl, Scratch& sc){
+                        auto& in = sc.level[2];
+                        size_t count = in.count;
+                        uint64_t const* a = in.num[0];
+                        uint64_t const* b = in.num[1];
+                        for(size_t op=0;op!=4;++op){
+                                if( ! ( ops_ & ( 1u << op ) ) )
+                                        continue;
+                                switch(op){
+                                case 0:
+                                        for(size_t s=0;s!=count;++s){
+                                                sc.valid[s] = ( a[s] + b[s] == in.target[s] );
+                                        }
+                                        break;
+                                case 1:
+                                        for(size_t s=0;s!=count;++s){
+                                                sc.valid[s] = ( a[s] * b[s] == in.target[s] );
+                                        }
+                                        break;
+                                default:
+                                        Checked(sc, op, a, b, count, NumberState::Step(0, 1, op), NumberState::Step(1, 0, op));
+                                        for(size_t s=0;s!=count;++s){
+                                                sc.valid[s] = sc.valid[s] && sc.value[s] == in.target[s];
+                                        }
+                                        break;
+                                }
+                                for(size_t s=0;s!=count;++s){
+                                        if( ! sc.valid[s] )
+                                                continue;
+                                        auto code = ( op < 2 ? NumberState::Step(0, 1, op) : sc.code[s] );
+                                        auto const& root = *sc.roots[in.root[s]];
+                                        auto trace = in.trace[s] | uint64_t{code};
+                                        ctrl->Emit(NumberState::Expressions(root.leaves, root.leaf_count, trace, 1).front());
+                                }
+                        }
+                        in.count = 0;
+                }
+
+                unsigned ops_;
+        };
+
+} // CandyTransform
+
+#endif // CANDY_TRANSFORM_NUMBER_SEARCH_H
@@ -0,0 +1,120 @@
+#ifndef CANDY_TRANSFORM_PIPELINE_H
+#define CANDY_TRANSFORM_PIPELINE_H
+
+#include "CandyTransform/Transform.h"
+
+#include <tuple>
+#include <type_traits>
+
+namespace CandyTransform{
+
+        /*
+         * Statically typed transform. Rather than going through a
+         * TransformControl, the continuation is a template parameter, so a
+         * chain of stages is composed at compile time and can be inlined
+         *
+         *     struct ToString : Stage<int, std::string>{
+         *             template<class C>
+         *             void operator()(C&& c, int in)const{
+         *                     c( boost::lexical_cast<std::string>(in) );
+         *             }
+         *     };
+         *
+         * The argument is passed as an rvalue when the previous stage emitted
+         * a temporary, so take it by const& or by value
+         */
+        template<class In_, class Out_>
+        struct Stage{
+                using In = In_;
+                using Out = Out_;
+        };
+
+        /*
+         * Chain of stages, built with operator|
+         *
+         *     auto p = Start<int>() | ToString{} | AllPerms{};
+         *
+         * A pipeline is itself a stage, so pipelines compose
+         */
+        template<class In_, class Out_, class... Stages>
+        struct Pipeline : Stage<In_, Out_>{
+                Pipeline()=default;
+                explicit Pipeline(std::tuple<Stages...> stages)
+                        :stages_(std::move(stages))
+                {}
+
+                std::tuple<Stages...> const& GetStages()const{ return stages_; }
+
+                template<class C, class V>
+                void operator()(C&& c, V&& in)const{
+                        this->template Run<0>(c, std::forward<V>(in));
+                }
+
+                std::vector<Out_> Execute(In_ const& in)const{
+                        std::vector<Out_> result;
+                        (*this)([&](auto&& out){
+                                result.push_back(std::forward<decltype(out)>(out));
+                        }, in);
+                        return result;
+                }
+
+                /*
+                 * Drop the pipeline into the type erased graph as a single
+                 * transform, ie
+                 *
+                 *     ctx.Start()->Next(p.AsTransform())->Next(...)
+                 */
+                std::shared_ptr<TransformBase> AsTransform(std::string const& name = "Pipeline")const;
+        private:
+                template<size_t I, class C, class V>
+                void Run(C& c, V&& v)const{
+                        if constexpr( I == sizeof...(Stages) ){
+                                c(std::forward<V>(v));
+                        } else {
+                                std::get<I>(stages_)([&](auto&& next){
+                                        this->template Run<I+1>(c, std::forward<decltype(next)>(next));
+                                }, std::forward<V>(v));
+                        }
+                }
+                std::tuple<Stages...> stages_;
+        };
+
+        template<class T>
+        Pipeline<T, T> Start(){ return Pipeline<T, T>{}; }
+
+        template<class In, class Out, class... Stages, class S>
+        Pipeline<In, typename S::Out, Stages..., S> operator|(Pipeline<In, Out, Stages...> const& p, S s){
+                static_assert( std::is_same<typename S::In, Out>::value, "stage input type doesn't match the pipeline output type");
+                return Pipeline<In, typename S::Out, Stages..., S>{
+                        std::tuple_cat(p.GetStages(), std::make_tuple(std::move(s)))};
+        }
+
+        /*
+         * Adapts a pipeline to the Transform interface, only the final
+         * output is boxed
+         */
+        template<class P>
+        struct PipelineTransform : Transform<typename P::In, typename P::Out>{
+                using ParamType = typename Transform<typename P::In, typename P::Out>::ParamType;
+                PipelineTransform(P p, std::string const& name)
+                        :p_(std::move(p))
+                {
+                        this->SetName(name);
+                }
+                virtual void Apply(TransformControl* ctrl, ParamType in)override{
+                        p_([ctrl](auto&& out){
+                                ctrl->Emit(std::forward<decltype(out)>(out));
+                        }, std::move(in));
+                }
+        private:
+                P p_;
+        };
+
+        template<class In_, class Out_, class... Stages>
+        std::shared_ptr<TransformBase> Pipeline<In_, Out_, Stages...>::AsTransform(std::string const& name)const{
+                return std::make_shared<PipelineTransform<Pipeline> >(*this, name);
+        }
+
+} // CandyTransform
+
+#endif // CANDY_TRANSFORM_PIPELINE_H
@@ -0,0 +1,177 @@
+#ifndef CANDY_TRANSFORM_TRACE_H
+#define CANDY_TRANSFORM_TRACE_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+#include "CandyTransform/Metrics.h"
+
+/*
+ * Tracing is compiled in with
+ *
+ *     #define CANDY_TRANSFORM_TRACE 1
+ *
+ * before the first include, and then recorded once F_Trace is set. Without
+ * it the recording folds away
+ */
+#ifndef CANDY_TRANSFORM_TRACE
+#define CANDY_TRANSFORM_TRACE 0
+#endif
+
+namespace CandyTransform{
+
+        /*
+         * One call of a transform. The name is copied, as transforms
+         * declared during an execution are gone by the time it's exported
+         */
+        struct TraceEvent{
+                enum{ NameSize = 32 };
+                char name[NameSize];
+                // nanoseconds since the log was made
+                uint64_t begin;
+                uint64_t end;
+                uint32_t depth;
+                uint32_t emits;
+                uint32_t tid;
+        };
+
+        /*
+         * Events of one thread, the oldest are overwritten once it's full.
+         * Only the owning thread records, so there's no lock
+         */
+        struct TraceRing{
+                explicit TraceRing(size_t capacity)
+                        :events_(std::max<size_t>(1, capacity))
+                {}
+                void Record(std::string const& name, uint64_t begin, uint64_t end, size_t depth, size_t emits){
+                        auto& e = events_[next_ % events_.size()];
+                        auto n = std::min<size_t>(name.size(), TraceEvent::NameSize - 1);
+                        std::memcpy(e.name, name.data(), n);
+                        e.name[n] = '\0';
+                        e.begin = begin;
+                        e.end = end;
+                        e.depth = static_cast<uint32_t>(depth);
+                        e.emits = static_cast<uint32_t>(emits);
+                        e.tid = ThreadId();
+                        ++next_;
+                }
+                template<class F>
+                void ForEach(F&& f)const{
+                        auto size = std::min(next_, events_.size());
+                        for(size_t idx=next_ - size;idx!=next_;++idx){
+                                f(events_[idx % events_.size()]);
+                        }
+                }
+                // events overwritten
+                size_t Dropped()const{ return next_ > events_.size() ? next_ - events_.size() : 0; }
+
+                /*
+                 * Small ids, in the order threads first record
+                 */
+                static uint32_t ThreadId(){
+                        static std::atomic<uint32_t> next{0};
+                        thread_local uint32_t id = next++;
+                        return id;
+                }
+        private:
+                std::vector<TraceEvent> events_;
+                size_t next_{0};
+        };
+
+        /*
+         * All the rings of a context, handed out to threads for an
+         * execution, as with TransformMetrics
+         */
+        struct TraceLog{
+                enum{ DefaultCapacity = 1 << 16 };
+
+                TraceLog()
+                        :epoch_(std::chrono::steady_clock::now())
+                {}
+                uint64_t Since(std::chrono::steady_clock::time_point t)const{
+                        return std::chrono::duration_cast<std::chrono::nanoseconds>(t - epoch_).count();
+                }
+                /*
+                 * Events kept per thread, for the rings made afterwards
+                 */
+                void SetCapacity(size_t capacity){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        capacity_ = capacity;
+                }
+                TraceRing* Acquire(){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        if( free_.size() ){
+                                auto ring = free_.back();
+                                free_.pop_back();
+                                return ring;
+                        }
+                        rings_.emplace_back(new TraceRing(capacity_));
+                        return rings_.back().get();
+                }
+                void Release(TraceRing* ring){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        free_.push_back(ring);
+                }
+
+                /*
+                 * Chrome trace event JSON, for chrome://tracing or Perfetto.
+                 * Must not be called during an execution
+                 */
+                void WriteChrome(std::ostream& ostr){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        size_t dropped = 0;
+                        ostr << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+                        const char* comma = "";
+                        for(auto const& ring : rings_){
+                                dropped += ring->Dropped();
+                                ring->ForEach([&](TraceEvent const& e){
+                                        ostr << comma << "{\"name\":";
+                                        MetricsSnapshot::PrintJsonString(ostr, e.name);
+                                        ostr << ",\"cat\":\"apply\",\"ph\":\"X\",\"pid\":1"
+                                             << ",\"tid\":" << e.tid
+                                             << ",\"ts\":";
+                                        PrintMicros(ostr, e.begin);
+                                        ostr << ",\"dur\":";
+                                        PrintMicros(ostr, e.end - e.begin);
+                                        ostr << ",\"args\":{\"depth\":" << e.depth << ",\"emits\":" << e.emits << "}}";
+                                        comma = ",";
+                                });
+                        }
+                        ostr << "],\"otherData\":{\"dropped\":" << dropped << "}}";
+                }
+                /*
+                 * Must not be called during an execution
+                 */
+                void Reset(){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        free_.clear();
+                        rings_.clear();
+                }
+        private:
+                static void PrintMicros(std::ostream& ostr, uint64_t nanos){
+                        char buf[32];
+                        std::snprintf(buf, sizeof(buf), "%llu.%03llu",
+                                static_cast<unsigned long long>(nanos / 1000),
+                                static_cast<unsigned long long>(nanos % 1000));
+                        ostr << buf;
+                }
+
+                std::chrono::steady_clock::time_point epoch_;
+                std::mutex mtx_;
+                size_t capacity_{DefaultCapacity};
+                std::vector<std::unique_ptr<TraceRing> > rings_;
+                std::vector<TraceRing*> free_;
+        };
+
+} // CandyTransform
+
+#endif // CANDY_TRANSFORM_TRACE_H
@@ -6,30 +6,83 @@
 #include <vector>
 #include <memory>
 #include <list>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <functional>
+#include <typeindex>
+#include <type_traits>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <limits>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/type_index.hpp>
 #include <boost/type_erasure/builtin.hpp>
+#include <boost/type_erasure/constructible.hpp>
 #include <boost/type_erasure/operators.hpp>
 #include <boost/type_erasure/any_cast.hpp>
 #include <boost/type_erasure/any.hpp>
 #include <boost/type_erasure/typeid_of.hpp>
 #include <boost/mpl/vector.hpp>
 #include <boost/optional.hpp>
+#include <boost/functional/hash.hpp>
+
+#include "CandyTransform/Metrics.h"
+#include "CandyTransform/Trace.h"
+#include "CandyTransform/Memory.h"
 
 
 namespace CandyTransform{
 
 
+        /*
+         * Chunked storage, elements are constructed in place in blocks of
+         * BlockSize, so pointers are stable and there is one allocation per
+         * block rather than per element
+         */
+        template<class T>
+        struct Arena{
+                enum{ BlockSize = 256 };
+                template<class... Args>
+                T* Make(Args&&... args){
+                        if( blocks_.empty() || blocks_.back().size() == BlockSize ){
+                                blocks_.emplace_back();
+                                blocks_.back().reserve(BlockSize);
+                        }
+                        blocks_.back().emplace_back(std::forward<Args>(args)...);
+                        ++size_;
+                        return &blocks_.back().back();
+                }
+                T& operator[](size_t idx){ return blocks_[idx / BlockSize][idx % BlockSize]; }
+                T const& operator[](size_t idx)const{ return blocks_[idx / BlockSize][idx % BlockSize]; }
+                size_t size()const{ return size_; }
+        private:
+                std::vector<std::vector<T> > blocks_;
+                size_t size_{0};
+        };
+
         struct GNode;
 
         struct GEdge{
-                GEdge(GNode* from, GNode* to)
-                        :from_(from),
+                GEdge(size_t id, GNode* from, GNode* to)
+                        :id_(id),
+                        from_(from),
                         to_(to)
                 {}
+                size_t Id()const{ return id_; }
                 GNode* From()const{ return from_; }
                 GNode* To()const{ return to_; }
 
@@ -37,13 +90,67 @@ namespace CandyTransform{
 
         private:
                 friend struct Graph;
+                friend struct EdgeRange;
+                size_t id_;
                 GNode* from_;
                 GNode* to_;
+                // intrusive adjacency lists
+                GEdge* next_out_{nullptr};
+                GEdge* next_in_{nullptr};
+        };
+
+        /*
+         * Edges of a node, either a slice of the frozen graph, or a walk
+         * of the nodes adjacency list
+         */
+        struct EdgeRange{
+                struct iterator{
+                        using iterator_category = std::forward_iterator_tag;
+                        using value_type = GEdge*;
+                        using difference_type = std::ptrdiff_t;
+                        using pointer = GEdge* const*;
+                        using reference = GEdge*;
+
+                        GEdge* operator*()const{ return csr_ ? *csr_ : e_; }
+                        iterator& operator++(){
+                                if( csr_ ){
+                                        ++csr_;
+                                } else {
+                                        e_ = e_->*next_;
+                                }
+                                return *this;
+                        }
+                        bool operator==(iterator const& that)const{ return csr_ == that.csr_ && e_ == that.e_; }
+                        bool operator!=(iterator const& that)const{ return ! ( *this == that ); }
+
+                        GEdge* const* csr_;
+                        GEdge* e_;
+                        GEdge* GEdge::* next_;
+                };
+                static EdgeRange Frozen(GEdge* const* first, size_t size){
+                        return EdgeRange{iterator{first, nullptr, nullptr}, iterator{first + size, nullptr, nullptr}, size};
+                }
+                static EdgeRange List(GEdge* head, GEdge* GEdge::* next, size_t size){
+                        return EdgeRange{iterator{nullptr, head, next}, iterator{nullptr, nullptr, next}, size};
+                }
+                static EdgeRange OutList(GEdge* head, size_t size){ return List(head, &GEdge::next_out_, size); }
+                static EdgeRange InList(GEdge* head, size_t size){ return List(head, &GEdge::next_in_, size); }
+
+                iterator begin()const{ return first_; }
+                iterator end()const{ return last_; }
+                size_t size()const{ return size_; }
+                bool empty()const{ return size_ == 0; }
+                GEdge* front()const{ return *first_; }
+
+                iterator first_;
+                iterator last_;
+                size_t size_;
         };
 
         struct GNode{
-                explicit GNode(std::string const& name)
-                        :name_(name)
+                GNode(size_t id, std::string const& name)
+                        :id_(id),
+                        name_(name)
                 {}
 
 
@@ -51,81 +158,224 @@ namespace CandyTransform{
                         std::vector<GEdge const*> rpath;
                         GNode const* head = this;
                         for(;;){
-                                // assume tree
-                                if( head->in_.size() != 1 ){
+                                // up to the start, or a join, see TransformContext::Join()
+                                auto in = head->InEdges();
+                                if( in.size() != 1 ){
                                         break;
                                 }
-                                auto e = head->in_.back();
-                                rpath.push_back(head->in_.back());
+                                rpath.push_back(in.front());
                                 head = rpath.back()->From();
                         }
                         return std::vector<GEdge const*>(rpath.rbegin(), rpath.rend());
                 }
 
+                size_t Id()const{ return id_; }
                 std::string const& Name()const{ return name_; }
-                
+
                 std::vector<GNode*> TerminalNodes(){
                         std::vector<GNode*> terminals;
                         std::vector<GNode*> stack{this};
+                        // paths can meet, so each node once
+                        std::unordered_set<GNode*> seen{this};
                         for(;stack.size();){
                                 auto head = stack.back();
                                 stack.pop_back();
                                 if( head->IsTerminal() ){
                                         terminals.push_back(head);
                                 } else{
-                                        for(auto e : head->out_){
-                                                stack.push_back(e->To());
+                                        for(auto e : head->OutEdges()){
+                                                if( seen.insert(e->To()).second )
+                                                        stack.push_back(e->To());
                                         }
                                 }
                         }
                         return terminals;
                 }
-                bool IsTerminal()const{ return out_.empty(); }
-        
+                bool IsTerminal()const{ return out_size_ == 0; }
+
 
                 friend std::ostream& operator<<(std::ostream& ostr, GNode const& self){
                         ostr << "{name=" << self.name_ << "}";
                         return ostr;
                 }
 
-                auto const& OutEdges(){ return out_; }
+                EdgeRange OutEdges()const{
+                        if( csr_out_ )
+                                return EdgeRange::Frozen(csr_out_, out_size_);
+                        return EdgeRange::OutList(out_head_, out_size_);
+                }
+                EdgeRange InEdges()const{
+                        if( csr_in_ )
+                                return EdgeRange::Frozen(csr_in_, in_size_);
+                        return EdgeRange::InList(in_head_, in_size_);
+                }
 
         private:
                 friend struct Graph;
+                size_t id_;
                 std::string name_;
-                std::vector<GEdge*> in_;
-                std::vector<GEdge*> out_;
+                GEdge* out_head_{nullptr};
+                GEdge* out_tail_{nullptr};
+                GEdge* in_head_{nullptr};
+                GEdge* in_tail_{nullptr};
+                size_t out_size_{0};
+                size_t in_size_{0};
+                // set when frozen, slices of the CSR arrays
+                GEdge* const* csr_out_{nullptr};
+                GEdge* const* csr_in_{nullptr};
         };
 
         std::ostream& operator<<(std::ostream& ostr, GEdge const& e){
                 return ostr << "{from=" << e.from_->Name() << ", to=" << e.to_->Name() << "}";
         }
 
+        /*
+         * Compressed sparse row adjacency, the edges of node i are
+         * [offset[i], offset[i+1]) of edge, with the node at the other end
+         * in node
+         */
+        struct CsrAdjacency{
+                std::vector<uint32_t> offset;
+                std::vector<uint32_t> edge;
+                std::vector<uint32_t> node;
+                // edge as pointers, for EdgeRange
+                std::vector<GEdge*> ptr;
+        };
+
         struct Graph{
+                /*
+                 * Ids start from the bases, so that a scratch graph can
+                 * extend another without the ids overlapping
+                 */
+                explicit Graph(size_t node_base = 0, size_t edge_base = 0)
+                        :node_base_(node_base),
+                        edge_base_(edge_base)
+                {}
                 GNode* Node(std::string const& name_){
-                        N.push_back(std::make_shared<GNode>(name_));
-                        return N.back().get();
+                        return N.Make(node_base_ + N.size(), name_);
                 }
                 GEdge* Edge(GNode* a, GNode* b){
-                        auto e = std::make_shared<GEdge>(a, b);
-                        a->out_.push_back(e.get());
-                        b->in_ .push_back(e.get());
-                        E.push_back(e);
-                        return E.back().get();
+                        if( a->csr_out_ || b->csr_in_ )
+                                Thaw();
+                        auto e = E.Make(edge_base_ + E.size(), a, b);
+                        if( a->out_tail_ ){
+                                a->out_tail_->next_out_ = e;
+                        } else {
+                                a->out_head_ = e;
+                        }
+                        a->out_tail_ = e;
+                        ++a->out_size_;
+                        if( b->in_tail_ ){
+                                b->in_tail_->next_in_ = e;
+                        } else {
+                                b->in_head_ = e;
+                        }
+                        b->in_tail_ = e;
+                        ++b->in_size_;
+                        return e;
+                }
+                size_t NodeCount()const{ return N.size(); }
+                size_t EdgeCount()const{ return E.size(); }
+                GNode* NodeAt(size_t id){ return &N[id - node_base_]; }
+                GEdge* EdgeAt(size_t id){ return &E[id - edge_base_]; }
+                size_t NodeBase()const{ return node_base_; }
+                size_t EdgeBase()const{ return edge_base_; }
+
+                /*
+                 * Pack the adjacency into contiguous arrays, nodes then walk
+                 * their edges from these rather than their lists. Nodes added
+                 * afterwards aren't frozen, and adding an edge to a frozen
+                 * node thaws the graph
+                 */
+                void Freeze(){
+                        Pack(out_, [](GEdge* e){ return e->From(); }, [](GEdge* e){ return e->To(); });
+                        Pack(in_,  [](GEdge* e){ return e->To(); },   [](GEdge* e){ return e->From(); });
+                        for(size_t idx=0;idx!=N.size();++idx){
+                                N[idx].csr_out_ = out_.ptr.data() + out_.offset[idx];
+                                N[idx].csr_in_  = in_.ptr.data()  + in_.offset[idx];
+                        }
+                        frozen_ = true;
                 }
+                bool Frozen()const{ return frozen_; }
+                CsrAdjacency const& OutCsr()const{ return out_; }
+                CsrAdjacency const& InCsr()const{ return in_; }
+
+                /*
+                 * Guards the graph, and anything colouring it, when it's
+                 * extended via DeclPath from a parallel execution
+                 */
+                std::shared_mutex& Mutex()const{ return mtx_; }
         private:
-                std::vector<std::shared_ptr<GNode> > N;
-                std::vector<std::shared_ptr<GEdge> > E;
+                template<class Key, class Other>
+                void Pack(CsrAdjacency& csr, Key key, Other other){
+                        csr.offset.assign(N.size()+1, 0);
+                        for(size_t idx=0;idx!=E.size();++idx){
+                                ++csr.offset[key(&E[idx])->Id() - node_base_ + 1];
+                        }
+                        for(size_t idx=0;idx!=N.size();++idx){
+                                csr.offset[idx+1] += csr.offset[idx];
+                        }
+                        csr.edge.resize(E.size());
+                        csr.node.resize(E.size());
+                        csr.ptr.resize(E.size());
+                        std::vector<uint32_t> cursor(csr.offset.begin(), csr.offset.end() - 1);
+                        // edge order, so the order of each nodes edges is kept
+                        for(size_t idx=0;idx!=E.size();++idx){
+                                auto e = &E[idx];
+                                auto pos = cursor[key(e)->Id() - node_base_]++;
+                                csr.edge[pos] = static_cast<uint32_t>(e->Id());
+                                csr.node[pos] = static_cast<uint32_t>(other(e)->Id());
+                                csr.ptr[pos] = e;
+                        }
+                }
+                void Thaw(){
+                        for(size_t idx=0;idx!=N.size();++idx){
+                                N[idx].csr_out_ = nullptr;
+                                N[idx].csr_in_  = nullptr;
+                        }
+                        frozen_ = false;
+                }
+
+                size_t node_base_;
+                size_t edge_base_;
+                Arena<GNode> N;
+                Arena<GEdge> E;
+                CsrAdjacency out_;
+                CsrAdjacency in_;
+                bool frozen_{false};
+                mutable std::shared_mutex mtx_;
         };
 
+        /*
+         * Property map of the nodes or edges of a graph, indexed by their
+         * dense ids. Ids start at base for a graph which extends another
+         */
         template<class T>
-        struct GraphColouring : std::unordered_map<void const*, T>{
-                T const& Color(void const* e)const{
-                        auto iter = this->find(e);
-                        if( iter == this->end())
+        struct GraphColouring{
+                explicit GraphColouring(size_t base = 0)
+                        :base_(base)
+                {}
+                template<class Item>
+                T& operator[](Item const* item){
+                        auto idx = item->Id() - base_;
+                        if( idx >= values_.size() )
+                                values_.resize(idx+1);
+                        return values_[idx];
+                }
+                template<class Item>
+                bool Contains(Item const* item)const{
+                        return item->Id() >= base_ && item->Id() - base_ < values_.size();
+                }
+                template<class Item>
+                T const& Color(Item const* item)const{
+                        if( ! Contains(item) )
                                 BOOST_THROW_EXCEPTION(std::domain_error("no colour"));
-                        return iter->second;
+                        return values_[item->Id() - base_];
                 }
+                size_t size()const{ return values_.size(); }
+        private:
+                size_t base_;
+                std::vector<T> values_;
         };
 
 
@@ -136,6 +386,27 @@ namespace CandyTransform{
 
         struct TransformControl;
 
+        /*
+         * Contiguous values, as passed to ApplyBatch
+         */
+        template<class T>
+        struct Span{
+                Span()=default;
+                Span(T* data, size_t size)
+                        :data_(data),
+                        size_(size)
+                {}
+                T* begin()const{ return data_; }
+                T* end()const{ return data_ + size_; }
+                T* data()const{ return data_; }
+                size_t size()const{ return size_; }
+                bool empty()const{ return size_ == 0; }
+                T& operator[](size_t idx)const{ return data_[idx]; }
+        private:
+                T* data_{nullptr};
+                size_t size_{0};
+        };
+
         namespace te = boost::type_erasure;
         namespace mpl = boost::mpl;
 
@@ -145,6 +416,9 @@ namespace CandyTransform{
                 //te::ostreamable<>,
                 te::copy_constructible<>,
                 te::assignable<>,
+                // so that values can be moved through the frontier
+                te::constructible<te::_self(te::_self&&)>,
+                te::assignable<te::_self, te::_self&&>,
                 // so that it can hold nothing
                 te::relaxed 
             >
@@ -157,15 +431,60 @@ namespace CandyTransform{
         struct TransformBase{
                 virtual ~TransformBase()=default;
                 virtual void ApplyImpl(TransformControl* ctrl)=0;
+                /*
+                 * Apply to arguments 0..n of ctrl at once, only called when
+                 * BatchSize() > 1
+                 */
+                virtual void ApplyBatchImpl(TransformControl* ctrl, size_t n){
+                        BOOST_THROW_EXCEPTION(std::logic_error("transform " + name_ + " doesn't take batches"));
+                }
+                /*
+                 * As ApplyImpl and ApplyBatchImpl, for arguments already
+                 * known to be of the In type, which is the case when the
+                 * graph has been validated
+                 */
+                virtual void ApplyUnchecked(TransformControl* ctrl){
+                        ApplyImpl(ctrl);
+                }
+                virtual void ApplyBatchUnchecked(TransformControl* ctrl, size_t n){
+                        ApplyBatchImpl(ctrl, n);
+                }
                 std::string const& Name()const{ return name_; }
+                /*
+                 * Most values the executor passes to ApplyBatchImpl at once,
+                 * 1 if the transform doesn't take batches
+                 */
+                size_t BatchSize()const{ return batch_size_; }
+                /*
+                 * Whether this can stand in for that as a continuation, in
+                 * which case declaring it from a transform reuses the node of
+                 * that rather than growing the graph
+                 */
+                virtual bool Interchangeable(TransformBase const& that)const{
+                        if( this == &that )
+                                return true;
+                        return stateless_ && typeid(*this) == typeid(that);
+                }
         protected:
                 void SetName(std::string const& name){
                         name_ = name;
                 }
-        protected:
+                /*
+                 * All instances of this type are interchangeable
+                 */
+                void SetStateless(){
+                        stateless_ = true;
+                }
+                void SetBatchSize(size_t n){
+                        batch_size_ = std::max<size_t>(1, n);
+                }
+        public:
                 virtual boost::typeindex::type_index GetInType()const=0;
                 virtual boost::typeindex::type_index GetOutType()const=0;
+        protected:
                 std::string name_;
+                bool stateless_{false};
+                size_t batch_size_{1};
         };
 
         struct PathDecl{
@@ -198,12 +517,15 @@ namespace CandyTransform{
                  *  }
                  */
                 virtual void Emit(AnyType const& val)=0;
+                virtual void Emit(AnyType&& val)=0;
                 /*
                  * End this path
                  */
                 virtual void Error(std::string const& msg)=0;
                 /*
-                 * Retreive an argument
+                 * Retreive an argument. Each transform is given it's own
+                 * argument, so it's safe to modify or move from it. Pass()
+                 * copies it as it is at the call
                  */
                 virtual AnyType& Arg(size_t idx=0)=0;
                 /*
@@ -211,6 +533,11 @@ namespace CandyTransform{
                  */
                 virtual size_t Depth()const=0;
 
+                /*
+                 * Declare a continuation for the values emitted by this call,
+                 * the declaration only valid until the transform returns.
+                 * Declaring from it after that throws std::logic_error
+                 */
                 virtual std::shared_ptr<PathDecl> DeclPath()=0;
 
                 // emit in arguments, ie
@@ -221,8 +548,61 @@ namespace CandyTransform{
                 //        c(t);
                 //    }
                 virtual void Pass()=0;
+                /*
+                 * Pass the idx'th argument of a batch. As Pass(), the
+                 * argument is copied as it is at the call
+                 */
+                virtual void PassArg(size_t idx)=0;
+                /*
+                 * While a batch is applied it's arguments are moved out of
+                 * Arg() into a Span, see Transform::ApplyBatchUnchecked(), so
+                 * PassArg() copies them from args with copy(args, idx)
+                 */
+                virtual void BindArgs(void const* args, AnyType(*copy)(void const*, size_t)){}
+                /*
+                 * Within ApplyBatch(), what's emitted, passed, returned and
+                 * declared from here on is of the idx'th argument, and is
+                 * routed as if that argument had been applied on it's own,
+                 * ie a Return() only replaces what that argument emitted.
+                 * The default ApplyBatch() does this for each argument.
+                 * Before Item() is called what a batch emits is of the batch
+                 * as a whole
+                 */
+                virtual void Item(size_t idx)=0;
                 
                 virtual void Return(AnyType const& value)=0;
+                virtual void Return(AnyType&& value)=0;
+
+                /*
+                 * Branch and bound, minimising a score. Bound() is the score
+                 * of the best solution published so far during this
+                 * execution, and Publish(score) offers a solution, returning
+                 * true when it's the new best, ie when to Return() it.
+                 *
+                 * EmitBounded(val, bound) emits val with bound being no more
+                 * than the score of any solution reachable from it. Values
+                 * which can't beat the best are dropped, and what's emitted
+                 * from a value inherits it's bound
+                 */
+                virtual double Bound()const=0;
+                virtual bool Publish(double score)=0;
+                virtual void EmitBounded(AnyType const& val, double bound)=0;
+                virtual void EmitBounded(AnyType&& val, double bound)=0;
+
+                /*
+                 * Detach this call from the executor, which carries on with
+                 * the frontier rather than waiting on it. The returned
+                 * control can be emitted to from any thread, after the
+                 * transform has returned, and what's emitted through it is
+                 * routed once it's released. Pass() isn't available, as the
+                 * argument isn't kept. An execution doesn't end until each
+                 * of it's deferred calls have been released, unless it's
+                 * cut short, ie a stream dropped early or an exception, in
+                 * which case the calls still held are detached and emitting
+                 * to them does nothing. What they reference then has to
+                 * outlive them, ie the transform
+                 */
+                virtual std::shared_ptr<TransformControl> Defer()=0;
                 
                 //virtual void Loop()=0;
         };
@@ -231,202 +611,3476 @@ namespace CandyTransform{
         struct Transform : TransformBase{
                 using ParamType = In_&;
                 virtual void Apply(TransformControl* ctrl, ParamType in)=0;
+                /*
+                 * Values arriving on the same edge at the same depth are
+                 * gathered into batches of up to BatchSize(), set with
+                 * SetBatchSize(), so that per call overhead is amortised.
+                 * The values are contiguous, and can be moved from once
+                 * they've been passed with PassArg(idx). The default applies each
+                 * in turn, as it's own Item()
+                 */
+                virtual void ApplyBatch(TransformControl* ctrl, Span<In_> in){
+                        for(size_t idx=0;idx!=in.size();++idx){
+                                ctrl->Item(idx);
+                                this->Apply(ctrl, in[idx]);
+                        }
+                }
 
         protected:
+                virtual void ApplyBatchImpl(TransformControl* ctrl, size_t n)override{
+                        for(size_t idx=0;idx!=n;++idx){
+                                if( ! CheckArg(ctrl, idx) )
+                                        return;
+                        }
+                        ApplyBatchUnchecked(ctrl, n);
+                }
+                virtual void ApplyBatchUnchecked(TransformControl* ctrl, size_t n)override{
+                        std::vector<In_> in;
+                        in.reserve(n);
+                        for(size_t idx=0;idx!=n;++idx){
+                                in.push_back(std::move(Unchecked(ctrl->Arg(idx))));
+                        }
+                        ctrl->BindArgs(in.data(), [](void const* args, size_t idx){
+                                return AnyType(static_cast<In_ const*>(args)[idx]);
+                        });
+                        this->ApplyBatch(ctrl, Span<In_>(in.data(), in.size()));
+                        ctrl->BindArgs(nullptr, nullptr);
+                }
                 virtual void ApplyImpl(TransformControl* ctrl)override{
-
-                        auto& arg0 = ctrl->Arg(0);
-                        if( te::typeid_of(arg0) != GetInType()){
-                                std::stringstream sstr;
-                                sstr << "Bad cast, expected " << GetInType().pretty_name() << ", but got " << 
-                                        boost::typeindex::type_index(te::typeid_of(arg0)).pretty_name();
-                                ctrl->Error(sstr.str());
+                        if( ! CheckArg(ctrl, 0) )
                                 return;
-                        }
-                        this->Apply( ctrl, te::any_cast<ParamType>(ctrl->Arg(0)) );
+                        ApplyUnchecked(ctrl);
                 }
-                
+                virtual void ApplyUnchecked(TransformControl* ctrl)override{
+                        this->Apply( ctrl, Unchecked(ctrl->Arg(0)) );
+                }
+                /*
+                 * The value of arg, which is known to be an In_, without
+                 * te::any_cast<>() comparing the typeids again
+                 */
+                static In_& Unchecked(AnyType& arg){
+                        assert( te::typeid_of(arg) == typeid(In_) && "emitted other than the Out type, see F_CheckTypes" );
+                        return *static_cast<In_*>(te::any_cast<void*>(&arg));
+                }
+        public:
                 virtual boost::typeindex::type_index GetInType()const{
                         return boost::typeindex::type_id<In_>().type_info();
                 }
                 virtual boost::typeindex::type_index GetOutType()const{
                         return boost::typeindex::type_id<Out_>().type_info();
                 }
+        private:
+                bool CheckArg(TransformControl* ctrl, size_t idx){
+                        auto& arg = ctrl->Arg(idx);
+                        if( te::typeid_of(arg) == typeid(In_) )
+                                return true;
+                        std::stringstream sstr;
+                        sstr << "Bad cast, expected " << GetInType().pretty_name() << ", but got " << 
+                                boost::typeindex::type_index(te::typeid_of(arg)).pretty_name();
+                        ctrl->Error(sstr.str());
+                        return false;
+                }
         };
 
         struct GraphPathDecl : PathDecl{
                 GraphPathDecl(Graph* G_, GNode* N_, GraphColouring<std::shared_ptr<TransformBase> >* T_):G{G_}, N{N_}, T{T_}{}
                 virtual std::shared_ptr<PathDecl> Next(std::shared_ptr<TransformBase> ptr)override{
+                        std::unique_lock<std::shared_mutex> lock(G->Mutex());
                         auto next = G->Node("foo");
                         auto e = G->Edge(N, next);
                         (*T)[e] = ptr;
                         return std::make_shared<GraphPathDecl>(G, next, T);
                 }
         private:
+                friend struct TransformContext;
                 Graph* G;
                 GNode* N;
                 GraphColouring<std::shared_ptr<TransformBase> >* T;
         };
 
-        struct Control : TransformControl{
-                virtual void Emit(AnyType const& val)override{
-                        E.push_back(val);
+        /*
+         * Continuation declared from within a transform. These are recorded
+         * in the Control, and only added to the graph once the transform has
+         * returned, so that identical continuations can share nodes. Node 0
+         * is the root, and DeclNode i is node i+1
+         */
+        struct DeclNode{
+                size_t parent;
+                std::shared_ptr<TransformBase> transform;
+        };
+
+        struct DeferredPathDecl;
+
+        /*
+         * The continuations declared by one call of a transform. The
+         * PathDecls handed out are pooled, and reused by the next call
+         * unless they're still held, in which case they're detached from
+         * the recorder, see TransformControl::DeclPath()
+         */
+        struct DeclRecorder{
+                DeclRecorder()=default;
+                DeclRecorder(DeclRecorder const&)=delete;
+                DeclRecorder& operator=(DeclRecorder const&)=delete;
+                ~DeclRecorder(){ Detach(); }
+
+                std::shared_ptr<PathDecl> At(size_t idx);
+                void Clear(){
+                        Detach();
+                        decl.clear();
+                        used_ = 0;
                 }
-                virtual AnyType& Arg(size_t idx){
-                        assert( idx == 0 );
-                        return A;
+
+                std::vector<DeclNode> decl;
+                // scratch for ExecutionScope::Intern
+                std::vector<std::vector<size_t> > kids;
+        private:
+                void Detach();
+
+                std::vector<std::shared_ptr<DeferredPathDecl> > pool_;
+                size_t used_{0};
+        };
+
+        struct DeferredPathDecl : PathDecl{
+                DeferredPathDecl(DeclRecorder* rec, size_t idx):rec_{rec}, idx_{idx}{}
+                virtual std::shared_ptr<PathDecl> Next(std::shared_ptr<TransformBase> ptr)override{
+                        if( ! rec_ )
+                                BOOST_THROW_EXCEPTION(std::logic_error("continuation declared after the transform returned"));
+                        rec_->decl.push_back(DeclNode{idx_, std::move(ptr)});
+                        return rec_->At(rec_->decl.size());
                 }
-                virtual void Error(std::string const& msg){
-                        errors_.push_back(msg);
+        private:
+                friend struct DeclRecorder;
+                DeclRecorder* rec_;
+                size_t idx_;
+        };
+
+        inline std::shared_ptr<PathDecl> DeclRecorder::At(size_t idx){
+                if( used_ == pool_.size() )
+                        pool_.emplace_back();
+                auto& ptr = pool_[used_++];
+                if( ! ptr )
+                        ptr = std::make_shared<DeferredPathDecl>(this, idx);
+                ptr->idx_ = idx;
+                return ptr;
+        }
+        inline void DeclRecorder::Detach(){
+                for(size_t idx=0;idx!=used_;++idx){
+                        if( pool_[idx].use_count() == 1 )
+                                continue;
+                        pool_[idx]->rec_ = nullptr;
+                        pool_[idx].reset();
                 }
-                virtual size_t Depth()const{ return depth_; }
+        }
 
-                virtual std::shared_ptr<PathDecl> DeclPath(){
-                        if( M == nullptr )
-                                M = G->Node("aux");
-                        return std::make_shared<GraphPathDecl>(G, M, T);
+        /*
+         * Binary encoding of values, used to move frontier items out of
+         * memory. Trivially copyable types, std::string and std::vector of
+         * those are encoded by default, anything else has to be registered
+         * with a write and read function
+         */
+        template<class T, class = void>
+        struct DefaultSerializer{
+                enum{ Available = false };
+        };
+        template<class T>
+        struct DefaultSerializer<T, std::enable_if_t<std::is_trivially_copyable<T>::value> >{
+                enum{ Available = true };
+                static void Write(std::ostream& ostr, T const& value){
+                        ostr.write(reinterpret_cast<char const*>(&value), sizeof(T));
                 }
-                virtual void Pass()override{
-                        E.push_back(A);
+                static T Read(std::istream& istr){
+                        T value;
+                        istr.read(reinterpret_cast<char*>(&value), sizeof(T));
+                        return value;
                 }
-                virtual void Return(AnyType const& value){
-                        return_ = value;
+        };
+        template<>
+        struct DefaultSerializer<std::string>{
+                enum{ Available = true };
+                static void Write(std::ostream& ostr, std::string const& value){
+                        DefaultSerializer<uint64_t>::Write(ostr, value.size());
+                        ostr.write(value.data(), value.size());
                 }
-                
-
-                Graph* G;
-                GNode* N;
-                GraphColouring<std::shared_ptr<TransformBase> >* T;
-                // arguments into the transform
-                AnyType A;
-
-                GNode* M{nullptr};
+                static std::string Read(std::istream& istr){
+                        std::string value(DefaultSerializer<uint64_t>::Read(istr), '\0');
+                        istr.read(&value[0], value.size());
+                        return value;
+                }
+        };
+        template<class T>
+        struct DefaultSerializer<std::vector<T>, std::enable_if_t<DefaultSerializer<T>::Available> >{
+                enum{ Available = true };
+                static void Write(std::ostream& ostr, std::vector<T> const& value){
+                        DefaultSerializer<uint64_t>::Write(ostr, value.size());
+                        for(auto const& _ : value){
+                                DefaultSerializer<T>::Write(ostr, _);
+                        }
+                }
+                static std::vector<T> Read(std::istream& istr){
+                        std::vector<T> value(DefaultSerializer<uint64_t>::Read(istr));
+                        for(auto& _ : value){
+                                _ = DefaultSerializer<T>::Read(istr);
+                        }
+                        return value;
+                }
+        };
 
+        struct ValueSerializer{
+                std::type_index type;
+                std::function<void(std::ostream&, AnyType const&)> write;
+                std::function<AnyType(std::istream&)> read;
+        };
 
-                // emitted "return" data
-                std::vector<AnyType> E;
-                // errors
-                std::vector<std::string> errors_;
+        /*
+         * Bytes of a value of type, passed the address of the value
+         */
+        struct ValueSizer{
+                std::type_index type;
+                std::function<size_t(void const*)> size;
+        };
 
-                size_t depth_{0};
+        /*
+         * Encoding of a continuation, so a checkpoint can restore the
+         * continuations declared during an execution
+         */
+        struct TransformSerializer{
+                std::type_index type;
+                std::function<void(std::ostream&, TransformBase const&)> write;
+                std::function<std::shared_ptr<TransformBase>(std::istream&)> read;
+        };
 
-                boost::optional<AnyType> return_;
+        /*
+         * Remembers which values have been seen at which node, so that
+         * equivalent states reached along different paths are only expanded
+         * once
+         */
+        struct TranspositionTable{
+                virtual ~TranspositionTable()=default;
+                /*
+                 * returns false if an equivalent value has already been seen
+                 * at node
+                 */
+                virtual bool Insert(GNode const* node, AnyType const& value)=0;
+                /*
+                 * From here on what the table holds is accounted to memory,
+                 * as MC_Tables
+                 */
+                virtual void Account(MemoryAccount* memory)=0;
         };
 
-        struct TransformContext{
-                enum{ Debug = false };
-                TransformContext(){
-                        head_ = G.Node("start");
-                }
-                std::shared_ptr<PathDecl> Start(){
-                        return std::make_shared<GraphPathDecl>(&G, head_, &T);
+        /*
+         * Values are compared by key(value), and either kept in a set, or
+         * with a capacity, a direct mapped table where a colliding entry
+         * replaces the old one. The bounded table can forget a state, and
+         * so expand it again, but never drops a state it hasn't seen
+         */
+        template<class T, class KeyFn, class Hash, class Equal>
+        struct TranspositionTableImpl : TranspositionTable{
+                using Key = std::decay_t<decltype(std::declval<KeyFn const&>()(std::declval<T const&>()))>;
+
+                TranspositionTableImpl(KeyFn key, Hash hash, Equal equal, size_t capacity)
+                        :key_(std::move(key)),
+                        hash_(std::move(hash)),
+                        seen_(0, EntryHash{}, EntryEqual{equal}),
+                        equal_(std::move(equal))
+                {
+                        slots_.resize(capacity);
                 }
 
+                virtual bool Insert(GNode const* node, AnyType const& value)override{
+                        Entry entry{node, 0, key_(te::any_cast<T const&>(value))};
+                        entry.hash = hash_(entry.key);
+                        boost::hash_combine(entry.hash, node);
+
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        if( slots_.empty() ){
+                                auto bytes = ( memory_ ? sizeof(Entry) + NodeOverhead + Owned(entry.key) : 0 );
+                                if( ! seen_.insert(std::move(entry)).second )
+                                        return false;
+                                if( memory_ )
+                                        memory_->Add(MC_Tables, bytes);
+                                return true;
+                        }
 
-                struct StackItem{
-                        StackItem(GNode* node_, AnyType A_, size_t depth_)
-                                :node(node_),
-                                A(A_),
-                                depth(depth_)
-                        {}
-                        friend std::ostream& operator<<(std::ostream& ostr,                 StackItem const& self){
-                                ostr << "node = " << self.node;
-                                //ostr << ", A = " << self.A;
-                                ostr << ", depth = " << self.depth;
-                                return ostr;
+                        auto& slot = slots_[entry.hash % slots_.size()];
+                        if( slot && slot->node == node && slot->hash == entry.hash && equal_(slot->key, entry.key) )
+                                return false;
+                        if( memory_ ){
+                                if( slot )
+                                        memory_->Sub(MC_Tables, Owned(slot->key));
+                                memory_->Add(MC_Tables, Owned(entry.key));
                         }
-                        GNode* node;
-                        AnyType A;
-                        size_t depth{0};
-                        bool operator<(StackItem const& that)const{
-                                if( depth != that.depth )
-                                       return depth < that.depth;
-                                return this < &that;
+                        slot = std::move(entry);
+                        return true;
+                }
+                virtual void Account(MemoryAccount* memory)override{
+                        memory_ = memory;
+                        memory_->Add(MC_Tables, slots_.size() * sizeof(slots_[0]));
+                }
+        private:
+                // the node of the set holding an entry, and it's bucket
+                enum{ NodeOverhead = 2 * sizeof(void*) };
+                /*
+                 * Bytes of the heap a key owns
+                 */
+                static size_t Owned(Key const& key){
+                        return DefaultValueSize<Key>::Of(key) - sizeof(Key);
+                }
+
+                struct Entry{
+                        GNode const* node;
+                        size_t hash;
+                        Key key;
+                };
+                struct EntryHash{
+                        size_t operator()(Entry const& e)const{ return e.hash; }
+                };
+                struct EntryEqual{
+                        bool operator()(Entry const& a, Entry const& b)const{
+                                return a.node == b.node && equal(a.key, b.key);
                         }
+                        Equal equal;
                 };
 
-                enum Flags{
-                        F_AggregateReturn = 1,
-                        F_ReturnTerminals = 2,
-                };
-                size_t flags_ = F_AggregateReturn | F_ReturnTerminals;
+                KeyFn key_;
+                Hash hash_;
+                std::unordered_set<Entry, EntryHash, EntryEqual> seen_;
+                Equal equal_;
+                std::vector<boost::optional<Entry> > slots_;
+                std::mutex mtx_;
+                // null when not accounted
+                MemoryAccount* memory_{nullptr};
+        };
 
-                template<class Out, class In>
-                std::vector<Out> Execute(In const& val){
-                        GraphColouring<std::vector<AnyType> > D;
-                        D[head_].push_back(val);
+        struct TranspositionFactory{
+                std::type_index type;
+                std::function<std::unique_ptr<TranspositionTable>()> make;
+        };
 
-                        std::priority_queue<StackItem> q;
-                        q.push(StackItem{head_, val, 0});
-                                
-                        enum{ MaxQueueSize = 1000 };
+        struct DedupeIdentity{
+                template<class T>
+                T const& operator()(T const& value)const{ return value; }
+        };
 
-                        std::vector<Out> result;
+        /*
+         * How the values reaching a join are merged, see
+         * TransformContext::Join()
+         */
+        enum JoinPolicy{
+                // every value goes on
+                JP_Union,
+                // only the first value to arrive goes on
+                JP_FirstWins,
+                // the values are folded into one, which goes on once nothing
+                // else can arrive
+                JP_Reduce,
+        };
 
-                        if( Debug ){
-                                std::cout << "head_->OutEdges().size() => " << head_->OutEdges().size() << "\n"; // __CandyPrint__(cxx-print-scalar,head_->OutEdges().size())
-                        }
+        /*
+         * What happens to values as they arrive at a node, rather than
+         * what's applied to them after
+         */
+        struct NodePolicy{
+                GNode* node{nullptr};
+                JoinPolicy join{JP_Union};
+                // reduce(acc, value) for JP_Reduce
+                std::function<void(AnyType&, AnyType&&)> reduce;
+                // drops values equivalent to one which already arrived, so
+                // what follows the node is evaluated once for them
+                boost::optional<TranspositionFactory> cache;
+                // index of the per execution state
+                size_t slot{0};
+        };
 
-                        for(;q.size();){
-                                auto s = q.top();
-                                q.pop();
+        /*
+         * Errors of executions, counted by transform and message, as the
+         * same error tends to repeat for every value
+         */
+        struct ErrorLog{
+                struct Entry{
+                        std::string transform;
+                        std::string message;
+                        size_t count;
+                };
+                enum{ MaxEntries = 64 };
 
-                                if( Debug ){
-                                        std::cout << "q.size() => " << q.size() << "\n"; // __CandyPrint__(cxx-print-scalar,q.size())
-                                        std::cout << "s.node->OutEdges().size() => " << s.node->OutEdges().size() << "\n"; // __CandyPrint__(cxx-print-scalar,s.node->OutEdges().size())
-                                        std::cout << "s => " << s << "\n"; // __CandyPrint__(cxx-print-scalar,s)
+                void Add(std::string const& transform, std::string const& message, size_t count = 1){
+                        for(auto& e : entries){
+                                if( e.transform == transform && e.message == message ){
+                                        e.count += count;
+                                        return;
                                 }
+                        }
+                        if( entries.size() == MaxEntries ){
+                                dropped += count;
+                                return;
+                        }
+                        entries.push_back(Entry{transform, message, count});
+                }
+                void Merge(ErrorLog const& that){
+                        for(auto const& e : that.entries){
+                                Add(e.transform, e.message, e.count);
+                        }
+                        dropped += that.dropped;
+                }
+                bool empty()const{ return entries.empty() && dropped == 0; }
+                void Print(std::ostream& ostr)const{
+                        for(auto const& e : entries){
+                                ostr << "{transform=" << e.transform
+                                     << ", message=" << e.message
+                                     << ", count=" << e.count
+                                     << "}\n";
+                        }
+                        if( dropped )
+                                ostr << "dropped = " << dropped << "\n";
+                }
 
-                                if( q.size() > MaxQueueSize )
-                                        throw std::domain_error("stack too large " + boost::lexical_cast<std::string>(q.size()));
-
+                std::vector<Entry> entries;
+                // errors beyond MaxEntries distinct ones
+                size_t dropped{0};
+        };
 
-                                if( s.node->OutEdges().empty() ){
-                                        if( flags_ & F_AggregateReturn ){
-                                                result.push_back(te::any_cast<Out>(s.A));
-                                        }
-                                        continue;
-                                }
+        /*
+         * Why to can't follow from, if it can't
+         */
+        inline boost::optional<std::string> EdgeTypeError(TransformBase const& from, TransformBase const& to){
+                if( from.GetOutType() == to.GetInType() )
+                        return boost::none;
+                std::stringstream sstr;
+                sstr << to.Name() << " takes " << to.GetInType().pretty_name()
+                     << ", but follows " << from.Name() << " which emits " << from.GetOutType().pretty_name();
+                return sstr.str();
+        }
 
-                                for( auto const& e : s.node->OutEdges() ){
-                                        auto t = T.Color(e);
+        struct PlanEdge{
+                TransformBase* transform{nullptr};
+                // whether to check the type of each argument, rather than
+                // ApplyUnchecked()
+                bool checked{true};
+        };
 
-                                        Control ctrl;
-                                        ctrl.G = &G;
-                                        ctrl.N = e->To();
-                                        ctrl.T = & T;
-                                        ctrl.A = s.A;
-                                        ctrl.depth_ = s.depth;
+        /*
+         * Graph resolved for execution, indexed by id, so the inner loop
+         * doesn't look up or refcount the transforms. The colouring owns
+         * them. Never changed once compiled, so it's shared by every
+         * execution of the graph, and extending the graph compiles a new
+         * plan rather than disturbing executions of the old one
+         */
+        struct ExecutionPlan{
+                EdgeRange OutEdges(GNode const* node)const{
+                        auto id = node->Id();
+                        return EdgeRange::Frozen(out_edge.data() + out_offset[id], out_offset[id+1] - out_offset[id]);
+                }
 
+                size_t node_count{0};
+                std::vector<PlanEdge> edge;
+                // largest batch any out edge of each node takes
+                std::vector<size_t> batch_limit;
+                // edges whose In isn't the Out of the edge before
+                std::vector<std::string> type_errors;
+                // the out edge of each node in the middle of a chain, see
+                // TransformContext::Fuse()
+                std::vector<GEdge*> chain;
+                // copy of the out CSR of the graph
+                std::vector<uint32_t> out_offset;
+                std::vector<GEdge*> out_edge;
+                // by slot, and by node when any node has one
+                std::vector<std::shared_ptr<NodePolicy const> > policies;
+                std::vector<NodePolicy const*> policy;
+                // slots of the JP_Reduce joins, in the order of the graph
+                std::vector<size_t> reducers;
+        };
 
-                                        if( Debug ){
-                                                std::cout << "t->Name() => " << t->Name() << "\n"; // __CandyPrint__(cxx-print-scalar,t->Name())
+        /*
+         * Calls detached with TransformControl::Defer(), queued once
+         * released, to be routed by whichever executor thread gets to them
+         * first
+         */
+        struct DeferredQueue{
+                /*
+                 * Shared with each deferred call, which is cut off from the
+                 * queue once it's cancelled
+                 */
+                struct Link{
+                        std::mutex mtx;
+                        DeferredQueue* queue{nullptr};
+                };
+                DeferredQueue()
+                        :link_(std::make_shared<Link>())
+                {
+                        link_->queue = this;
+                }
+                DeferredQueue(DeferredQueue const&)=delete;
+                DeferredQueue& operator=(DeferredQueue const&)=delete;
+
+                std::shared_ptr<Link> const& GetLink()const{ return link_; }
+                void Start(){
+                        ++in_flight_;
+                }
+                void Complete(std::unique_ptr<TransformControl> call){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        done_.push_back(std::move(call));
+                        ++ready_;
+                        cv_.notify_all();
+                }
+                /*
+                 * A released call, or null
+                 */
+                std::unique_ptr<TransformControl> Take(){
+                        if( ready_ == 0 )
+                                return nullptr;
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        if( done_.empty() )
+                                return nullptr;
+                        auto call = std::move(done_.front());
+                        done_.pop_front();
+                        --ready_;
+                        return call;
+                }
+                /*
+                 * Once a taken call has been routed
+                 */
+                void Done(){
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        --in_flight_;
+                        cv_.notify_all();
+                }
+                bool Ready()const{ return ready_ != 0; }
+                size_t InFlight()const{ return in_flight_; }
+                /*
+                 * Blocks until a call is released, or none are in flight
+                 */
+                void Wait(){
+                        std::unique_lock<std::mutex> lock(mtx_);
+                        cv_.wait(lock, [this](){ return ready_ != 0 || in_flight_ == 0; });
+                }
+                /*
+                 * Drops the released calls, and detaches those still in
+                 * flight, so that emitting to them does nothing and
+                 * releasing them only frees them. For when the execution
+                 * ends without waiting on them, ie a stream dropped early
+                 * or an exception
+                 */
+                void Cancel(){
+                        std::lock_guard<std::mutex> link(link_->mtx);
+                        link_->queue = nullptr;
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        done_.clear();
+                        ready_ = 0;
+                        in_flight_ = 0;
+                }
+        private:
+                std::mutex mtx_;
+                std::condition_variable cv_;
+                std::deque<std::unique_ptr<TransformControl> > done_;
+                std::atomic<size_t> in_flight_{0};
+                std::atomic<size_t> ready_{0};
+                std::shared_ptr<Link> link_;
+        };
+
+        /*
+         * Per execution part of the graph. Continuations declared by
+         * transforms are interned here, keyed on the edge which declared
+         * them, so the graph grows with the shape of the search rather than
+         * with the number of values. Freed in bulk when the execution ends
+         */
+        struct ExecutionScope{
+                ExecutionScope(std::shared_ptr<ExecutionPlan const> base, std::vector<TranspositionFactory> const& dedupe)
+                        :base_(base),
+                        G(base->node_count, base->edge.size()),
+                        T(base->edge.size()),
+                        plan_(base->edge.size()),
+                        batch_limit_(base->node_count)
+                {
+                        for(auto const& f : dedupe){
+                                tables_.emplace_back(f.type, f.make());
+                        }
+                        for(auto const& p : base->policies){
+                                nodes_.emplace_back(new NodeState);
+                                if( p->cache )
+                                        nodes_.back()->cache = p->cache->make();
+                        }
+                }
+                ~ExecutionScope(){
+                        deferred_.Cancel();
+                }
+
+                /*
+                 * Whether an equivalent of value has already been seen at node
+                 */
+                bool Seen(GNode const* node, AnyType const& value){
+                        if( tables_.empty() )
+                                return false;
+                        std::type_index type = te::typeid_of(value);
+                        for(auto& t : tables_){
+                                if( t.first == type )
+                                        return ! t.second->Insert(node, value);
+                        }
+                        return false;
+                }
+
+                /*
+                 * Applies the policy of node to a value arriving at it, at
+                 * depth. False when the value doesn't go on, as it was
+                 * dropped, or folded into the join
+                 */
+                bool Arrive(GNode const* node, AnyType& value, size_t depth){
+                        if( node->Id() >= base_->policy.size() )
+                                return true;
+                        auto p = base_->policy[node->Id()];
+                        if( ! p )
+                                return true;
+                        auto& state = *nodes_[p->slot];
+                        // values of other types aren't cached, as in Seen()
+                        if( state.cache && p->cache->type == std::type_index(te::typeid_of(value)) && ! state.cache->Insert(node, value) )
+                                return false;
+                        switch(p->join){
+                        case JP_Union:
+                                return true;
+                        case JP_FirstWins:
+                                return ! state.fired.exchange(true);
+                        case JP_Reduce:
+                                {
+                                        std::lock_guard<std::mutex> lock(state.mtx);
+                                        if( state.acc ){
+                                                auto bytes = ( memory_ ? SizeOf(*state.acc) : 0 );
+                                                p->reduce(*state.acc, std::move(value));
+                                                if( memory_ ){
+                                                        memory_->Sub(MC_Joins, bytes);
+                                                        memory_->Add(MC_Joins, SizeOf(*state.acc));
+                                                }
+                                        } else {
+                                                state.acc = std::move(value);
+                                                if( memory_ )
+                                                        memory_->Add(MC_Joins, SizeOf(*state.acc));
+                                        }
+                                        state.depth = std::max(state.depth, depth);
+                                        return false;
+                                }
+                        }
+                        return true;
+                }
+                /*
+                 * Releases the folded value of the first JP_Reduce join, in
+                 * the order of the graph, which has one, with
+                 * release(node, value, depth). Only when quiescent(), ie
+                 * nothing else can arrive at it, which is checked under the
+                 * lock so that two workers can't both release
+                 */
+                template<class Quiescent, class Release>
+                bool Flush(Quiescent&& quiescent, Release&& release){
+                        if( base_->reducers.empty() )
+                                return false;
+                        std::lock_guard<std::mutex> lock(flush_mtx_);
+                        if( ! quiescent() )
+                                return false;
+                        for(auto slot : base_->reducers){
+                                auto& state = *nodes_[slot];
+                                boost::optional<AnyType> acc;
+                                {
+                                        std::lock_guard<std::mutex> acc_lock(state.mtx);
+                                        if( state.acc ){
+                                                acc = std::move(state.acc.get());
+                                                state.acc = boost::none;
+                                        }
+                                }
+                                if( ! acc )
+                                        continue;
+                                if( memory_ )
+                                        memory_->Sub(MC_Joins, SizeOf(acc.get()));
+                                release(base_->policies[slot]->node, std::move(acc.get()), state.depth);
+                                return true;
+                        }
+                        return false;
+                }
+
+                /*
+                 * Node for the continuations rec declared from e, whose
+                 * transform is from. Type errors of new continuations are
+                 * logged, and those edges checked
+                 */
+                GNode* Intern(GEdge const* e, TransformBase const& from, DeclRecorder& rec, ErrorLog& errors){
+                        auto const& decl = rec.decl;
+                        auto& kids = rec.kids;
+                        if( kids.size() < decl.size()+1 )
+                                kids.resize(decl.size()+1);
+                        for(size_t idx=0;idx!=decl.size()+1;++idx){
+                                kids[idx].clear();
+                        }
+                        for(size_t idx=0;idx!=decl.size();++idx){
+                                kids[decl[idx].parent].push_back(idx+1);
+                        }
+
+                        std::unique_lock<std::shared_mutex> lock(mtx_);
+                        auto& candidates = interned_[e];
+                        for(auto root : candidates){
+                                if( Match(decl, kids, 0, root) )
+                                        return root;
+                        }
+                        auto root = G.Node("aux");
+                        Materialize(decl, kids, 0, root, from, errors);
+                        candidates.push_back(root);
+                        return root;
+                }
+                PlanEdge Color(GEdge const* e)const{
+                        std::shared_lock<std::shared_mutex> lock(mtx_);
+                        return plan_.Color(e);
+                }
+                size_t BatchLimit(GNode const* node)const{
+                        std::shared_lock<std::shared_mutex> lock(mtx_);
+                        return batch_limit_.Color(node);
+                }
+                Graph const& GetGraph()const{ return G; }
+                /*
+                 * The compiled graph this extends
+                 */
+                ExecutionPlan const& Plan()const{ return *base_; }
+                EdgeRange OutEdges(GNode const* node)const{
+                        if( node->Id() < base_->node_count )
+                                return base_->OutEdges(node);
+                        return node->OutEdges();
+                }
+
+                /*
+                 * The incumbent of branch and bound, lowered without a lock
+                 */
+                double Bound()const{ return incumbent_.load(std::memory_order_acquire); }
+                bool Publish(double score){
+                        auto best = incumbent_.load(std::memory_order_relaxed);
+                        for(;score < best;){
+                                if( incumbent_.compare_exchange_weak(best, score, std::memory_order_acq_rel) )
+                                        return true;
+                        }
+                        return false;
+                }
+                bool Prunable(double bound)const{ return bound >= Bound(); }
+
+                DeferredQueue& Deferred(){ return deferred_; }
+
+                /*
+                 * Accounts the memory of the execution to account, sizing
+                 * values with sizes, see TransformContext::SetMemoryBudget()
+                 */
+                void Account(std::vector<ValueSizer> const* sizes, std::unique_ptr<MemoryAccount> account){
+                        sizes_ = sizes;
+                        memory_ = std::move(account);
+                        for(auto& t : tables_){
+                                t.second->Account(memory_.get());
+                        }
+                        for(auto& _ : nodes_){
+                                if( _->cache )
+                                        _->cache->Account(memory_.get());
+                        }
+                }
+                // null when not accounted
+                MemoryAccount* Memory()const{ return memory_.get(); }
+                /*
+                 * Bytes of a value, the box holding it, and what it's size
+                 * function says when it's type has one
+                 */
+                size_t SizeOf(std::type_index type, void const* value)const{
+                        size_t bytes = sizeof(AnyType);
+                        for(auto const& _ : *sizes_){
+                                if( _.type == type )
+                                        return bytes + _.size(value);
+                        }
+                        return bytes;
+                }
+                size_t SizeOf(AnyType const& value)const{
+                        return SizeOf(te::typeid_of(value), te::any_cast<void const*>(&value));
+                }
+
+                GNode* NodeAt(size_t id){ return G.NodeAt(id); }
+                GEdge* EdgeAt(size_t id){ return G.EdgeAt(id); }
+
+                /*
+                 * Writes the continuations interned so far, and the state of
+                 * the joins, for a checkpoint, each transform with
+                 * write(ostr, transform) and each value with
+                 * write_value(ostr, value)
+                 */
+                template<class Write, class WriteValue>
+                void Save(std::ostream& ostr, Write&& write, WriteValue&& write_value){
+                        std::shared_lock<std::shared_mutex> lock(mtx_);
+                        DefaultSerializer<uint64_t>::Write(ostr, nodes_.size());
+                        for(auto const& state : nodes_){
+                                DefaultSerializer<uint8_t>::Write(ostr, state->fired.load());
+                                DefaultSerializer<uint64_t>::Write(ostr, state->depth);
+                                DefaultSerializer<uint8_t>::Write(ostr, !! state->acc);
+                                if( state->acc )
+                                        write_value(ostr, state->acc.get());
+                        }
+                        DefaultSerializer<uint64_t>::Write(ostr, G.NodeCount());
+                        DefaultSerializer<uint64_t>::Write(ostr, G.EdgeCount());
+                        for(size_t idx=0;idx!=G.EdgeCount();++idx){
+                                auto e = G.EdgeAt(G.EdgeBase() + idx);
+                                DefaultSerializer<uint64_t>::Write(ostr, e->From()->Id());
+                                DefaultSerializer<uint64_t>::Write(ostr, e->To()->Id());
+                                write(ostr, *T.Color(e));
+                        }
+                        DefaultSerializer<uint64_t>::Write(ostr, interned_.size());
+                        for(auto const& p : interned_){
+                                DefaultSerializer<uint64_t>::Write(ostr, p.first->Id());
+                                DefaultSerializer<uint64_t>::Write(ostr, p.second.size());
+                                for(auto root : p.second){
+                                        DefaultSerializer<uint64_t>::Write(ostr, root->Id());
+                                }
+                        }
+                }
+                /*
+                 * Restores what Save() wrote into an empty scope of the
+                 * same base graph, each transform with read(istr). The
+                 * restored edges are type checked per argument
+                 */
+                template<class Read, class ReadValue>
+                void Load(std::istream& istr, Graph& base, Read&& read, ReadValue&& read_value){
+                        std::unique_lock<std::shared_mutex> lock(mtx_);
+                        if( DefaultSerializer<uint64_t>::Read(istr) != nodes_.size() )
+                                BOOST_THROW_EXCEPTION(std::domain_error("checkpoint is of different joins"));
+                        for(auto& state : nodes_){
+                                state->fired = DefaultSerializer<uint8_t>::Read(istr);
+                                state->depth = DefaultSerializer<uint64_t>::Read(istr);
+                                if( DefaultSerializer<uint8_t>::Read(istr) ){
+                                        state->acc = read_value(istr);
+                                        if( memory_ )
+                                                memory_->Add(MC_Joins, SizeOf(state->acc.get()));
+                                }
+                        }
+                        auto nodes = DefaultSerializer<uint64_t>::Read(istr);
+                        for(size_t idx=0;idx!=nodes;++idx){
+                                batch_limit_[G.Node("aux")] = 1;
+                        }
+                        auto edges = DefaultSerializer<uint64_t>::Read(istr);
+                        for(size_t idx=0;idx!=edges;++idx){
+                                auto from = NodeOf(base, DefaultSerializer<uint64_t>::Read(istr));
+                                auto to = NodeOf(base, DefaultSerializer<uint64_t>::Read(istr));
+                                std::shared_ptr<TransformBase> t = read(istr);
+                                auto e = G.Edge(from, to);
+                                T[e] = t;
+                                plan_[e] = PlanEdge{t.get(), true};
+                                auto& limit = batch_limit_[from];
+                                limit = std::max(limit, t->BatchSize());
+                                if( memory_ )
+                                        memory_->Add(MC_Graph, ContinuationBytes);
+                        }
+                        auto keys = DefaultSerializer<uint64_t>::Read(istr);
+                        for(size_t idx=0;idx!=keys;++idx){
+                                auto id = DefaultSerializer<uint64_t>::Read(istr);
+                                GEdge const* e = ( id < base_->edge.size() ? base.EdgeAt(id) : G.EdgeAt(id) );
+                                auto& roots = interned_[e];
+                                roots.resize(DefaultSerializer<uint64_t>::Read(istr));
+                                for(auto& root : roots){
+                                        root = NodeOf(base, DefaultSerializer<uint64_t>::Read(istr));
+                                }
+                        }
+                }
+        private:
+                /*
+                 * Of a continuation interned, the node and edge and their
+                 * colours, but not the transform itself
+                 */
+                enum{ ContinuationBytes = sizeof(GNode) + sizeof(GEdge) + sizeof(std::shared_ptr<TransformBase>) + sizeof(PlanEdge) + sizeof(size_t) };
+
+                /*
+                 * Of a node with a policy
+                 */
+                struct NodeState{
+                        std::atomic<bool> fired{false};
+                        std::unique_ptr<TranspositionTable> cache;
+                        std::mutex mtx;
+                        boost::optional<AnyType> acc;
+                        // of the deepest value folded into acc
+                        size_t depth{0};
+                };
+
+                GNode* NodeOf(Graph& base, size_t id){
+                        return id < base_->node_count ? base.NodeAt(id) : G.NodeAt(id);
+                }
+                bool Match(std::vector<DeclNode> const& decl, std::vector<std::vector<size_t> > const& kids, size_t idx, GNode const* node)const{
+                        auto out = node->OutEdges();
+                        if( out.size() != kids[idx].size() )
+                                return false;
+                        auto k = kids[idx].begin();
+                        for( auto e : out ){
+                                auto const& t = decl[*k-1].transform;
+                                if( ! t->Interchangeable(*T.Color(e)) )
+                                        return false;
+                                if( ! Match(decl, kids, *k, e->To()) )
+                                        return false;
+                                ++k;
+                        }
+                        return true;
+                }
+                void Materialize(std::vector<DeclNode> const& decl, std::vector<std::vector<size_t> > const& kids, size_t idx, GNode* node, TransformBase const& from, ErrorLog& errors){
+                        size_t limit = 1;
+                        for(auto k : kids[idx]){
+                                auto next = G.Node("foo");
+                                auto e = G.Edge(node, next);
+                                auto const& t = decl[k-1].transform;
+                                T[e] = t;
+                                auto err = EdgeTypeError(from, *t);
+                                if( err )
+                                        errors.Add(t->Name(), err.get());
+                                plan_[e] = PlanEdge{t.get(), !! err};
+                                limit = std::max(limit, t->BatchSize());
+                                if( memory_ )
+                                        memory_->Add(MC_Graph, ContinuationBytes);
+                                Materialize(decl, kids, k, next, *t, errors);
+                        }
+                        batch_limit_[node] = limit;
+                }
+
+                std::shared_ptr<ExecutionPlan const> base_;
+                Graph G;
+                GraphColouring<std::shared_ptr<TransformBase> > T;
+                GraphColouring<PlanEdge> plan_;
+                GraphColouring<size_t> batch_limit_;
+                std::unordered_map<GEdge const*, std::vector<GNode*> > interned_;
+                mutable std::shared_mutex mtx_;
+                std::vector<std::pair<std::type_index, std::unique_ptr<TranspositionTable> > > tables_;
+                std::atomic<double> incumbent_{ std::numeric_limits<double>::infinity() };
+                DeferredQueue deferred_;
+                // by slot of the policy
+                std::vector<std::unique_ptr<NodeState> > nodes_;
+                std::mutex flush_mtx_;
+                std::vector<ValueSizer> const* sizes_{nullptr};
+                std::unique_ptr<MemoryAccount> memory_;
+        };
+
+        /*
+         * Moving an AnyType allocates a new copy of the value, whereas
+         * assigning to one which holds the same type doesn't. So values
+         * are moved through the frontier boxed, and spent boxes are kept
+         * to be assigned into
+         */
+        struct ValuePool{
+                using Box = std::unique_ptr<AnyType>;
+
+                template<class V>
+                Box Make(V&& value){
+                        if( free_.empty() )
+                                return Box(new AnyType(std::forward<V>(value)));
+                        Box box = std::move(free_.back());
+                        free_.pop_back();
+                        *box = std::forward<V>(value);
+                        return box;
+                }
+                void Recycle(Box box){
+                        if( box && free_.size() < Capacity )
+                                free_.push_back(std::move(box));
+                }
+        private:
+                enum{ Capacity = 4096 };
+                std::vector<Box> free_;
+        };
+
+        struct Control : TransformControl{
+                explicit Control(ValuePool* pool)
+                        :pool_(pool)
+                {}
+                virtual void Emit(AnyType const& val)override{
+                        E.push_back(pool_->Make(val));
+                        Account(E.size()-1);
+                }
+                virtual void Emit(AnyType&& val)override{
+                        E.push_back(pool_->Make(std::move(val)));
+                        Account(E.size()-1);
+                }
+                virtual AnyType& Arg(size_t idx){
+                        if( batch_.size() )
+                                return batch_[idx];
+                        assert( idx == 0 );
+                        return A;
+                }
+                virtual void Error(std::string const& msg){
+                        errors_.push_back(msg);
+                }
+                virtual size_t Depth()const{ return depth_; }
+
+                virtual std::shared_ptr<PathDecl> DeclPath(){
+                        declared_ = true;
+                        return decl_.At(0);
+                }
+                virtual void Pass()override{
+                        PassArg(item_);
+                }
+                /*
+                 * The argument is still referenced by the transform, which
+                 * may go on to change it, so it's copied
+                 */
+                virtual void PassArg(size_t idx)override{
+                        if( copy_arg_ ){
+                                E.push_back(pool_->Make(copy_arg_(args_, idx)));
+                        } else {
+                                E.push_back(pool_->Make(Arg(idx)));
+                        }
+                        Account(E.size()-1);
+                }
+                virtual void BindArgs(void const* args, AnyType(*copy)(void const*, size_t))override{
+                        args_ = args;
+                        copy_arg_ = copy;
+                }
+                virtual void Item(size_t idx)override{
+                        if( itemised_ || E.size() || return_ || declared_ )
+                                EndItem();
+                        itemised_ = true;
+                        item_ = idx;
+                }
+                /*
+                 * Closes the segment of E since the last Item(), with what
+                 * was returned and declared for it
+                 */
+                void EndItem(){
+                        segments_.emplace_back();
+                        auto& seg = segments_.back();
+                        seg.begin = begin_;
+                        seg.end = E.size();
+                        seg.bound = ( itemised_ && item_ < batch_bounds_.size() ? batch_bounds_[item_] : bound_ );
+                        seg.return_ = std::move(return_);
+                        return_ = boost::none;
+                        seg.declared = declared_;
+                        declared_ = false;
+                        seg.decl.swap(decl_.decl);
+                        begin_ = E.size();
+                }
+                /*
+                 * Calls to Return(), of each item of a batch
+                 */
+                size_t Returns()const{
+                        size_t n = ( return_ ? 1 : 0 );
+                        for(auto const& _ : segments_){
+                                n += ( _.return_ ? 1 : 0 );
+                        }
+                        return n;
+                }
+                virtual void Return(AnyType const& value){
+                        return_ = value;
+                }
+                virtual void Return(AnyType&& value){
+                        return_ = std::move(value);
+                }
+                virtual double Bound()const{ return scope_->Bound(); }
+                virtual bool Publish(double score){ return scope_->Publish(score); }
+                virtual void EmitBounded(AnyType const& val, double bound){
+                        Emit(val);
+                        SetBound(bound);
+                }
+                virtual void EmitBounded(AnyType&& val, double bound){
+                        Emit(std::move(val));
+                        SetBound(bound);
+                }
+                virtual std::shared_ptr<TransformControl> Defer()override;
+                static double NoBound(){ return -std::numeric_limits<double>::infinity(); }
+                void SetBound(double bound){
+                        bounds_.resize(E.size(), NoBound());
+                        bounds_.back() = bound;
+                }
+                /*
+                 * Bound of the idx'th emitted value, from an argument of
+                 * bound
+                 */
+                double BoundOf(size_t idx, double bound)const{
+                        if( idx < bounds_.size() )
+                                return std::max(bound, bounds_[idx]);
+                        return bound;
+                }
+                /*
+                 * Bytes of the idx'th emitted value, which is no longer
+                 * accounted as emitted, as it's being routed. 0 when the
+                 * execution isn't accounted
+                 */
+                size_t Release(size_t idx){
+                        if( idx >= bytes_.size() || bytes_[idx] == 0 )
+                                return 0;
+                        auto bytes = bytes_[idx];
+                        bytes_[idx] = 0;
+                        scope_->Memory()->Sub(MC_Emitted, bytes);
+                        return bytes;
+                }
+                void ReleaseAll(){
+                        for(size_t idx=0;idx!=bytes_.size();++idx){
+                                Release(idx);
+                        }
+                }
+                /*
+                 * Ready for the next call, the buffers keep their capacity
+                 */
+                void Reset(ExecutionScope* scope, GEdge const* e, size_t depth, double bound){
+                        scope_ = scope;
+                        edge_ = e;
+                        N = e->To();
+                        batch_ = Span<AnyType>();
+                        declared_ = false;
+                        decl_.Clear();
+                        for(auto& _ : E){
+                                pool_->Recycle(std::move(_));
+                        }
+                        E.clear();
+                        // only left over when the execution failed
+                        bytes_.clear();
+                        args_ = nullptr;
+                        copy_arg_ = nullptr;
+                        errors_.clear();
+                        depth_ = depth;
+                        bound_ = bound;
+                        bounds_.clear();
+                        return_ = boost::none;
+                        batch_bounds_.clear();
+                        item_ = 0;
+                        itemised_ = false;
+                        begin_ = 0;
+                        segments_.clear();
+                }
+
+
+                // edge of the transform, to N
+                GEdge const* edge_{nullptr};
+                GNode* N{nullptr};
+                // arguments into the transform
+                AnyType A;
+                // or the arguments of a batch
+                Span<AnyType> batch_;
+
+                // continuations from DeclPath
+                bool declared_{false};
+                DeclRecorder decl_;
+
+                /*
+                 * What one argument of a batch emitted, see Item()
+                 */
+                struct Segment{
+                        // of E
+                        size_t begin;
+                        size_t end;
+                        double bound;
+                        boost::optional<AnyType> return_;
+                        bool declared;
+                        std::vector<DeclNode> decl;
+                };
+                // bound of each argument of a batch
+                std::vector<double> batch_bounds_;
+                // argument of the current Item()
+                size_t item_{0};
+                bool itemised_{false};
+                // of the open segment
+                size_t begin_{0};
+                std::vector<Segment> segments_;
+
+                // emitted "return" data
+                std::vector<ValuePool::Box> E;
+                // bytes of each of E, when the execution is accounted
+                std::vector<size_t> bytes_;
+                // the typed arguments of a batch, see BindArgs()
+                void const* args_{nullptr};
+                AnyType(*copy_arg_)(void const*, size_t){nullptr};
+                // errors
+                std::vector<std::string> errors_;
+
+                size_t depth_{0};
+
+                boost::optional<AnyType> return_;
+
+                ExecutionScope* scope_{nullptr};
+                // bound of the arguments, and of E when emitted bounded
+                double bound_{NoBound()};
+                std::vector<double> bounds_;
+
+                // boxes of E, shared with the executor
+                ValuePool* pool_;
+        private:
+                void Account(size_t idx){
+                        auto memory = scope_->Memory();
+                        if( ! memory )
+                                return;
+                        bytes_.resize(E.size());
+                        bytes_[idx] = scope_->SizeOf(*E[idx]);
+                        memory->Add(MC_Emitted, bytes_[idx]);
+                }
+        };
+
+        /*
+         * A call detached from the executor, see TransformControl::Defer().
+         * It has it's own pool, as it's emitted to from other threads
+         */
+        struct DeferredControl : Control{
+                DeferredControl(Control const& that, std::shared_ptr<DeferredQueue::Link> link)
+                        :Control(&own_),
+                        link_(std::move(link))
+                {
+                        Reset(that.scope_, that.edge_, that.depth_, that.bound_);
+                }
+                /*
+                 * The scope is gone once the queue is cancelled, so what
+                 * touches it does nothing from then on
+                 */
+                virtual void Emit(AnyType const& val)override{
+                        std::lock_guard<std::mutex> lock(link_->mtx);
+                        if( link_->queue )
+                                Control::Emit(val);
+                }
+                virtual void Emit(AnyType&& val)override{
+                        std::lock_guard<std::mutex> lock(link_->mtx);
+                        if( link_->queue )
+                                Control::Emit(std::move(val));
+                }
+                virtual void EmitBounded(AnyType const& val, double bound)override{
+                        std::lock_guard<std::mutex> lock(link_->mtx);
+                        if( link_->queue )
+                                Control::EmitBounded(val, bound);
+                }
+                virtual void EmitBounded(AnyType&& val, double bound)override{
+                        std::lock_guard<std::mutex> lock(link_->mtx);
+                        if( link_->queue )
+                                Control::EmitBounded(std::move(val), bound);
+                }
+                virtual double Bound()const override{
+                        std::lock_guard<std::mutex> lock(link_->mtx);
+                        return link_->queue ? Control::Bound() : std::numeric_limits<double>::infinity();
+                }
+                virtual bool Publish(double score)override{
+                        std::lock_guard<std::mutex> lock(link_->mtx);
+                        return link_->queue && Control::Publish(score);
+                }
+                virtual void PassArg(size_t idx)override{
+                        Error("can't Pass() a deferred call, Emit() the argument instead");
+                }
+                virtual std::shared_ptr<TransformControl> Defer()override{
+                        BOOST_THROW_EXCEPTION(std::logic_error("call is already deferred"));
+                }
+        private:
+                ValuePool own_;
+                std::shared_ptr<DeferredQueue::Link> link_;
+        };
+
+        /*
+         * Released to the queue of the scope, rather than deleted, unless
+         * the queue has been cancelled
+         */
+        inline std::shared_ptr<TransformControl> Control::Defer(){
+                auto& queue = scope_->Deferred();
+                auto link = queue.GetLink();
+                auto call = new DeferredControl(*this, link);
+                queue.Start();
+                return std::shared_ptr<TransformControl>(call, [link](TransformControl* ptr){
+                        std::unique_ptr<TransformControl> call(ptr);
+                        std::lock_guard<std::mutex> lock(link->mtx);
+                        if( link->queue )
+                                link->queue->Complete(std::move(call));
+                });
+        }
+
+        /*
+         * Edge from the end of a branch to the join, see
+         * TransformContext::Join()
+         */
+        template<class T>
+        struct JoinTransform : Transform<T, T>{
+                JoinTransform(){
+                        this->SetName("Join");
+                        this->SetStateless();
+                }
+                virtual void Apply(TransformControl* ctrl, typename Transform<T, T>::ParamType in)override{
+                        ctrl->Pass();
+                }
+        };
+
+        /*
+         * Order a sequential execution expands it's frontier in, see
+         * TransformContext::SetFrontierPolicy()
+         */
+        enum FrontierPolicy{
+                // deepest first, the least memory
+                FP_DepthFirst,
+                // shallowest first, the shortest paths first
+                FP_BreadthFirst,
+                // depth first down to a limit, which is raised by a step
+                // once only what's past it is left
+                FP_IterativeDeepening,
+                // least score first, see SetFrontierScore()
+                FP_BestFirst,
+        };
+        /*
+         * Of items at the same depth, or with the same score
+         */
+        enum FrontierOrder{
+                // the newest first
+                FO_Lifo,
+                // the oldest first
+                FO_Fifo,
+        };
+
+        /*
+         * Folds the results of an execution as they're produced, see
+         * TransformContext::Reduce(). A reducer is
+         *
+         *     void Add(Out&& value);
+         *     void Merge(Reducer&& that);
+         *     R Result();
+         *
+         * A parallel execution copies the reducer for each worker, and
+         * merges the copies at the end, so a reducer should start out
+         * empty
+         */
+        template<class Out>
+        struct CollectReducer{
+                void Add(Out&& value){ values_.push_back(std::move(value)); }
+                void Merge(CollectReducer&& that){
+                        if( values_.empty() ){
+                                values_ = std::move(that.values_);
+                                return;
+                        }
+                        std::move(that.values_.begin(), that.values_.end(), std::back_inserter(values_));
+                }
+                std::vector<Out> Result(){ return std::move(values_); }
+        private:
+                std::vector<Out> values_;
+        };
+        /*
+         * Whether a reducer holds on to each result, so they're accounted
+         * to the memory of the execution
+         */
+        template<class Reducer>
+        struct KeepsResults : std::false_type{};
+        template<class Out>
+        struct KeepsResults<CollectReducer<Out> > : std::true_type{};
+
+        struct CountReducer{
+                template<class Out>
+                void Add(Out&&){ ++count_; }
+                void Merge(CountReducer&& that){ count_ += that.count_; }
+                size_t Result(){ return count_; }
+        private:
+                size_t count_{0};
+        };
+
+        /*
+         * The result with the least key(value) by Less, or none. Of equal
+         * keys the first kept
+         */
+        template<class Out, class KeyFn = DedupeIdentity, class Less = std::less<> >
+        struct MinReducer{
+                explicit MinReducer(KeyFn key = KeyFn{}, Less less = Less{})
+                        :key_(std::move(key)),
+                        less_(std::move(less))
+                {}
+                void Add(Out&& value){
+                        if( ! best_ || less_(key_(value), key_(best_.get())) )
+                                best_ = std::move(value);
+                }
+                void Merge(MinReducer&& that){
+                        if( that.best_ )
+                                Add(std::move(that.best_.get()));
+                }
+                boost::optional<Out> Result(){ return std::move(best_); }
+        private:
+                KeyFn key_;
+                Less less_;
+                boost::optional<Out> best_;
+        };
+        template<class Out, class KeyFn = DedupeIdentity>
+        struct MaxReducer : MinReducer<Out, KeyFn, std::greater<> >{
+                explicit MaxReducer(KeyFn key = KeyFn{})
+                        :MinReducer<Out, KeyFn, std::greater<> >(std::move(key))
+                {}
+        };
+
+        /*
+         * The k results with the greatest key(value), greatest first. Only
+         * k are kept at any time
+         */
+        template<class Out, class KeyFn = DedupeIdentity>
+        struct TopKReducer{
+                explicit TopKReducer(size_t k, KeyFn key = KeyFn{})
+                        :k_(k),
+                        key_(std::move(key))
+                {}
+                void Add(Out&& value){
+                        if( k_ == 0 )
+                                return;
+                        if( heap_.size() == k_ ){
+                                if( ! ( key_(heap_.front()) < key_(value) ) )
+                                        return;
+                                std::pop_heap(heap_.begin(), heap_.end(), Greater());
+                                heap_.back() = std::move(value);
+                        } else {
+                                heap_.push_back(std::move(value));
+                        }
+                        std::push_heap(heap_.begin(), heap_.end(), Greater());
+                }
+                void Merge(TopKReducer&& that){
+                        for(auto& _ : that.heap_){
+                                Add(std::move(_));
+                        }
+                }
+                std::vector<Out> Result(){
+                        std::sort_heap(heap_.begin(), heap_.end(), Greater());
+                        return std::move(heap_);
+                }
+        private:
+                // min heap, so the front is the one to drop
+                auto Greater()const{
+                        return [this](Out const& a, Out const& b){ return key_(b) < key_(a); };
+                }
+                size_t k_;
+                KeyFn key_;
+                std::vector<Out> heap_;
+        };
+
+        /*
+         * acc = fold(acc, value) for each result, and the accumulators of the
+         * workers are combined with acc = merge(acc, that). Each worker
+         * starts from init, so init has to be the identity of merge
+         */
+        template<class Out, class Acc, class Fold, class Merge_>
+        struct FoldReducer{
+                FoldReducer(Acc init, Fold fold, Merge_ merge)
+                        :acc_(std::move(init)),
+                        fold_(std::move(fold)),
+                        merge_(std::move(merge))
+                {}
+                void Add(Out&& value){ acc_ = fold_(std::move(acc_), std::move(value)); }
+                void Merge(FoldReducer&& that){ acc_ = merge_(std::move(acc_), std::move(that.acc_)); }
+                Acc Result(){ return std::move(acc_); }
+        private:
+                Acc acc_;
+                Fold fold_;
+                Merge_ merge_;
+        };
+        template<class Out, class Acc, class Fold, class Merge_>
+        FoldReducer<Out, Acc, Fold, Merge_> MakeFoldReducer(Acc init, Fold fold, Merge_ merge){
+                return FoldReducer<Out, Acc, Fold, Merge_>(std::move(init), std::move(fold), std::move(merge));
+        }
+
+        struct TransformContext{
+                enum{ Debug = false };
+                // see Trace.h
+                enum{ Tracing = CANDY_TRANSFORM_TRACE };
+                TransformContext(){
+                        head_ = G.Node("start");
+                }
+                std::shared_ptr<PathDecl> Start(){
+                        return std::make_shared<GraphPathDecl>(&G, head_, &T);
+                }
+
+
+                /*
+                 * Move only, so that payloads are never copied through the
+                 * frontier
+                 */
+                struct StackItem{
+                        StackItem(GNode* node_, AnyType A_, size_t depth_)
+                                :node(node_),
+                                A(new AnyType(std::move(A_))),
+                                depth(depth_)
+                        {}
+                        StackItem(GNode* node_, ValuePool::Box A_, size_t depth_, double bound_ = Control::NoBound())
+                                :node(node_),
+                                A(std::move(A_)),
+                                depth(depth_),
+                                bound(bound_)
+                        {}
+                        StackItem(StackItem&&)=default;
+                        StackItem& operator=(StackItem&&)=default;
+                        StackItem(StackItem const&)=delete;
+                        StackItem& operator=(StackItem const&)=delete;
+                        friend std::ostream& operator<<(std::ostream& ostr,                 StackItem const& self){
+                                ostr << "node = " << self.node;
+                                //ostr << ", A = " << self.A;
+                                ostr << ", depth = " << self.depth;
+                                return ostr;
+                        }
+                        GNode* node;
+                        // boxed, so moving an item doesn't copy the value
+                        ValuePool::Box A;
+                        size_t depth{0};
+                        // see TransformControl::EmitBounded()
+                        double bound{Control::NoBound()};
+                        // accounted to the frontier, see SetMemoryBudget()
+                        size_t bytes{0};
+                };
+
+                /*
+                 * Items waiting to be expanded by a sequential execution,
+                 * in the order of the policy. Items are kept in a queue per
+                 * depth, so pushing and popping is O(1), other than for
+                 * FP_BestFirst, which is a heap on the score
+                 */
+                struct Frontier{
+                        Frontier(FrontierPolicy policy, FrontierOrder order, size_t step, std::function<double(AnyType const&)> score)
+                                :policy_(policy),
+                                order_(order),
+                                step_(std::max<size_t>(1, step)),
+                                limit_( policy == FP_IterativeDeepening ? step_ : std::numeric_limits<size_t>::max() ),
+                                score_(std::move(score))
+                        {}
+
+                        void Push(StackItem&& item){
+                                if( policy_ == FP_BestFirst ){
+                                        auto score = score_(*item.A);
+                                        heap_.push_back(Scored{score, seq_++, std::move(item)});
+                                        std::push_heap(heap_.begin(), heap_.end(), Later());
+                                        ++size_;
+                                        return;
+                                }
+                                auto depth = item.depth;
+                                if( buckets_.size() <= depth )
+                                        buckets_.resize(depth + 1);
+                                buckets_[depth].push_back(std::move(item));
+                                if( size_ == 0 ){
+                                        lo_ = hi_ = depth;
+                                } else {
+                                        lo_ = std::min(lo_, depth);
+                                        hi_ = std::max(hi_, depth);
+                                }
+                                ++size_;
+                        }
+                        /*
+                         * Not when empty
+                         */
+                        StackItem Pop(){
+                                --size_;
+                                if( policy_ == FP_BestFirst ){
+                                        std::pop_heap(heap_.begin(), heap_.end(), Later());
+                                        StackItem item = std::move(heap_.back().item);
+                                        heap_.pop_back();
+                                        return item;
+                                }
+                                auto& bucket = buckets_[Next()];
+                                if( order_ == FO_Fifo ){
+                                        StackItem item = std::move(bucket.front());
+                                        bucket.pop_front();
+                                        return item;
+                                }
+                                StackItem item = std::move(bucket.back());
+                                bucket.pop_back();
+                                return item;
+                        }
+                        /*
+                         * Whether the next item is at node and depth, for
+                         * gathering a batch, valid after a Pop()
+                         */
+                        bool NextIs(GNode const* node, size_t depth)const{
+                                if( size_ == 0 )
+                                        return false;
+                                if( policy_ == FP_BestFirst ){
+                                        auto const& top = heap_.front().item;
+                                        return top.node == node && top.depth == depth;
+                                }
+                                if( depth >= buckets_.size() || buckets_[depth].empty() )
+                                        return false;
+                                auto const& bucket = buckets_[depth];
+                                return ( order_ == FO_Fifo ? bucket.front() : bucket.back() ).node == node;
+                        }
+                        size_t size()const{ return size_; }
+                        bool empty()const{ return size_ == 0; }
+                        template<class F>
+                        void ForEach(F&& f)const{
+                                for(auto const& _ : heap_){
+                                        f(_.item);
+                                }
+                                for(auto const& bucket : buckets_){
+                                        for(auto const& _ : bucket){
+                                                f(_);
+                                        }
+                                }
+                        }
+                        /*
+                         * The count items which would be popped last, to be
+                         * spilled
+                         */
+                        std::vector<StackItem> TakeColdest(size_t count){
+                                count = std::min(count, size_);
+                                std::vector<StackItem> cold;
+                                if( policy_ == FP_BestFirst ){
+                                        auto mid = heap_.end() - count;
+                                        std::nth_element(heap_.begin(), mid, heap_.end(), [this](Scored const& a, Scored const& b){
+                                                return Later()(b, a);
+                                        });
+                                        for(auto iter=mid;iter!=heap_.end();++iter){
+                                                cold.push_back(std::move(iter->item));
+                                        }
+                                        heap_.erase(mid, heap_.end());
+                                        std::make_heap(heap_.begin(), heap_.end(), Later());
+                                        size_ -= count;
+                                        return cold;
+                                }
+                                // iterative deepening only gets to what's past
+                                // the limit once the rest is done
+                                size_t past = ( policy_ == FP_IterativeDeepening && hi_ > limit_ ? hi_ - limit_ : 0 );
+                                for(size_t k=0;cold.size() != count;++k){
+                                        // the shallowest, or the deepest breadth first, or past the limit
+                                        auto& bucket = buckets_[ policy_ == FP_BreadthFirst || k < past ? hi_ - k : lo_ + k - past ];
+                                        for(;bucket.size() && cold.size() != count;){
+                                                if( order_ == FO_Fifo ){
+                                                        cold.push_back(std::move(bucket.back()));
+                                                        bucket.pop_back();
+                                                } else {
+                                                        cold.push_back(std::move(bucket.front()));
+                                                        bucket.pop_front();
+                                                }
+                                        }
+                                }
+                                size_ -= count;
+                                return cold;
+                        }
+                private:
+                        struct Scored{
+                                double score;
+                                uint64_t seq;
+                                StackItem item;
+                        };
+                        /*
+                         * Whether a is popped after b
+                         */
+                        struct After{
+                                bool operator()(Scored const& a, Scored const& b)const{
+                                        if( a.score != b.score )
+                                                return a.score > b.score;
+                                        return fifo ? a.seq > b.seq : a.seq < b.seq;
+                                }
+                                bool fifo;
+                        };
+                        After Later()const{ return After{order_ == FO_Fifo}; }
+                        /*
+                         * Bucket to pop from, not when empty
+                         */
+                        size_t Next(){
+                                for(;buckets_[lo_].empty();++lo_);
+                                if( policy_ == FP_BreadthFirst )
+                                        return lo_;
+                                for(;buckets_[hi_].empty();--hi_);
+                                for(;limit_ < lo_;){
+                                        limit_ += step_;
+                                }
+                                auto top = std::min(hi_, limit_);
+                                for(;buckets_[top].empty();--top);
+                                return top;
+                        }
+
+                        FrontierPolicy policy_;
+                        FrontierOrder order_;
+                        size_t step_;
+                        size_t limit_;
+                        std::function<double(AnyType const&)> score_;
+                        std::vector<std::deque<StackItem> > buckets_;
+                        // the buckets which can have items are [lo_, hi_]
+                        size_t lo_{0};
+                        size_t hi_{0};
+                        std::vector<Scored> heap_;
+                        uint64_t seq_{0};
+                        size_t size_{0};
+                };
+
+                /*
+                 * Frontier items moved out to a file. Segments are reloaded
+                 * last in first out, so the file is used as a stack, and
+                 * only ever as large as the deepest point of the spill
+                 */
+                struct SpillStack{
+                        SpillStack(std::vector<ValueSerializer> const& ser, std::string const& dir)
+                                :ser_(ser)
+                        {
+                                static std::atomic<size_t> counter{0};
+                                std::stringstream name;
+                                name << "CandyTransform-spill-" << std::random_device{}() << "-" << counter++;
+                                path_ = ( dir.size() ? std::filesystem::path(dir) : std::filesystem::temp_directory_path() ) / name.str();
+                                file_.open(path_, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+                                if( ! file_ )
+                                        BOOST_THROW_EXCEPTION(std::runtime_error("unable to open spill file " + path_.string()));
+                        }
+                        ~SpillStack(){
+                                file_.close();
+                                std::error_code ec;
+                                std::filesystem::remove(path_, ec);
+                        }
+
+                        ValueSerializer const* Find(AnyType const& value)const{
+                                std::type_index type = te::typeid_of(value);
+                                for(auto const& s : ser_){
+                                        if( s.type == type )
+                                                return &s;
+                                }
+                                return nullptr;
+                        }
+
+                        /*
+                         * Writes the items as one segment, the items are
+                         * left moved from
+                         */
+                        template<class Iter>
+                        void Push(Iter first, Iter last){
+                                Segment seg{end_, 0};
+                                file_.seekp(end_);
+                                for(;first!=last;++first){
+                                        auto s = Find(*first->A);
+                                        assert( s && "only spill serializable items" );
+                                        DefaultSerializer<uint32_t>::Write(file_, static_cast<uint32_t>(s - &ser_[0]));
+                                        DefaultSerializer<uintptr_t>::Write(file_, reinterpret_cast<uintptr_t>(first->node));
+                                        DefaultSerializer<uint64_t>::Write(file_, first->depth);
+                                        DefaultSerializer<double>::Write(file_, first->bound);
+                                        s->write(file_, *first->A);
+                                        ++seg.count;
+                                }
+                                end_ = file_.tellp();
+                                if( ! file_ )
+                                        BOOST_THROW_EXCEPTION(std::runtime_error("unable to write spill file " + path_.string()));
+                                items_ += seg.count;
+                                segments_.push_back(seg);
+                        }
+                        /*
+                         * Reloads the last segment
+                         */
+                        template<class Sink>
+                        void Pop(Sink&& sink){
+                                auto seg = segments_.back();
+                                segments_.pop_back();
+                                file_.seekg(seg.offset);
+                                for(size_t idx=0;idx!=seg.count;++idx){
+                                        sink(Read());
+                                }
+                                if( ! file_ )
+                                        BOOST_THROW_EXCEPTION(std::runtime_error("unable to read spill file " + path_.string()));
+                                items_ -= seg.count;
+                                end_ = seg.offset;
+                        }
+                        /*
+                         * Reads every item, oldest segment first, without
+                         * reloading them
+                         */
+                        template<class Sink>
+                        void ForEach(Sink&& sink){
+                                for(auto const& seg : segments_){
+                                        file_.seekg(seg.offset);
+                                        for(size_t idx=0;idx!=seg.count;++idx){
+                                                sink(Read());
+                                        }
+                                }
+                                if( ! file_ )
+                                        BOOST_THROW_EXCEPTION(std::runtime_error("unable to read spill file " + path_.string()));
+                        }
+                        bool empty()const{ return segments_.empty(); }
+                        size_t size()const{ return items_; }
+                private:
+                        StackItem Read(){
+                                auto const& s = ser_.at(DefaultSerializer<uint32_t>::Read(file_));
+                                auto node = reinterpret_cast<GNode*>(DefaultSerializer<uintptr_t>::Read(file_));
+                                auto depth = DefaultSerializer<uint64_t>::Read(file_);
+                                auto bound = DefaultSerializer<double>::Read(file_);
+                                StackItem item{node, s.read(file_), depth};
+                                item.bound = bound;
+                                return item;
+                        }
+                        struct Segment{
+                                std::streamoff offset;
+                                size_t count;
+                        };
+                        std::vector<ValueSerializer> const& ser_;
+                        std::filesystem::path path_;
+                        std::fstream file_;
+                        std::vector<Segment> segments_;
+                        std::streamoff end_{0};
+                        size_t items_{0};
+                };
+
+                /*
+                 * Writes the items which can be serialized out to the spill,
+                 * in segments of at most segment items, coldest first so the
+                 * warmest segment is reloaded first. Items which can't be
+                 * serialized are left in items. Spilled items are no longer
+                 * accounted to memory
+                 */
+                static void SpillItems(std::vector<StackItem>& items, SpillStack& spill, size_t segment, MemoryAccount* memory){
+                        auto last = std::stable_partition(items.begin(), items.end(), [&](StackItem const& s){
+                                return spill.Find(*s.A) != nullptr;
+                        });
+                        if( memory ){
+                                for(auto iter = items.begin(); iter != last; ++iter){
+                                        memory->Sub(MC_Frontier, iter->bytes);
+                                }
+                        }
+                        std::stable_sort(items.begin(), last, [](StackItem const& a, StackItem const& b){
+                                return a.depth < b.depth;
+                        });
+                        for(auto first = items.begin(); first != last;){
+                                auto n = std::min<size_t>(segment, last - first);
+                                spill.Push(first, first + n);
+                                first += n;
+                        }
+                        items.erase(items.begin(), last);
+                }
+
+                enum Flags{
+                        F_AggregateReturn = 1,
+                        F_ReturnTerminals = 2,
+                        // per transform counters and latency, see Metrics(),
+                        // off by default as each call reads the clock
+                        F_Metrics = 4,
+                        // check the type of every argument, rather than only
+                        // validating the graph before executing, which only
+                        // shows the declared types fit. On in debug builds
+                        F_CheckTypes = 8,
+                        // values reaching a chain of transforms go straight
+                        // down it rather than through the frontier, only
+                        // depth first without a frontier budget, see
+                        // SetFrontierPolicy()
+                        F_FuseChains = 16,
+                        // a timeline of the calls of transforms, see
+                        // WriteTrace(), only when compiled in
+                        F_Trace = 32,
+                        // bytes held by each execution, see
+                        // SetMemoryBudget(), always on with a budget
+                        F_Memory = 64,
+                };
+#ifndef NDEBUG
+                // a transform emitting other than it's Out type is logged
+                // as an error, rather than being undefined
+                enum{ DefaultChecks = F_CheckTypes };
+#else
+                enum{ DefaultChecks = 0 };
+#endif
+                size_t flags_ = F_AggregateReturn | F_ReturnTerminals | F_FuseChains | DefaultChecks;
+
+                /*
+                 * State of one executor thread
+                 */
+                struct WorkerState{
+                        explicit WorkerState(TransformContext* ctx)
+                                :pool(new ValuePool),
+                                ctrl(new Control(pool.get())),
+                                ctx_(ctx),
+                                owner_( ctx->flags_ & F_Metrics ? &ctx->metrics_ : nullptr ),
+                                trace_owner_( Tracing && ( ctx->flags_ & F_Trace ) ? &ctx->trace_ : nullptr )
+                        {
+                                if( owner_ )
+                                        metrics = owner_->Acquire();
+                                if( trace_owner_ )
+                                        trace = trace_owner_->Acquire();
+                        }
+                        WorkerState(WorkerState&& that)
+                                :pool(std::move(that.pool)),
+                                ctrl(std::move(that.ctrl)),
+                                fused(std::move(that.fused)),
+                                level(that.level),
+                                args(std::move(that.args)),
+                                errors(std::move(that.errors)),
+                                metrics(that.metrics),
+                                trace(that.trace),
+                                ctx_(that.ctx_),
+                                owner_(that.owner_),
+                                trace_owner_(that.trace_owner_)
+                        {
+                                that.ctx_ = nullptr;
+                                that.owner_ = nullptr;
+                                that.trace_owner_ = nullptr;
+                        }
+                        WorkerState(WorkerState const&)=delete;
+                        WorkerState& operator=(WorkerState const&)=delete;
+                        ~WorkerState(){
+                                if( owner_ )
+                                        owner_->Release(metrics);
+                                if( trace_owner_ )
+                                        trace_owner_->Release(trace);
+                                if( ctx_ && ! errors.empty() ){
+                                        std::lock_guard<std::mutex> lock(ctx_->errors_mtx_);
+                                        ctx_->errors_.Merge(errors);
+                                }
+                        }
+
+                        /*
+                         * Control of the ith fused stage, see Fuse()
+                         */
+                        Control& Level(size_t idx){
+                                if( idx == 0 )
+                                        return *ctrl;
+                                for(;fused.size() < idx;){
+                                        fused.emplace_back(new Control(pool.get()));
+                                }
+                                return *fused[idx-1];
+                        }
+
+                        std::unique_ptr<ValuePool> pool;
+                        /*
+                         * Reset for each call, so a steady state execution
+                         * only allocates for the values themselves
+                         */
+                        std::unique_ptr<Control> ctrl;
+                        std::vector<std::unique_ptr<Control> > fused;
+                        size_t level{0};
+                        // arguments of a batch
+                        std::vector<AnyType> args;
+                        // merged into the context's when done
+                        ErrorLog errors;
+                        // null when metrics are off
+                        MetricsShard* metrics{nullptr};
+                        // null unless tracing
+                        TraceRing* trace{nullptr};
+                private:
+                        TransformContext* ctx_;
+                        TransformMetrics* owner_;
+                        TraceLog* trace_owner_;
+                };
+
+                /*
+                 * Counters of every execution so far, summed by transform
+                 * name, with F_Metrics
+                 */
+                MetricsSnapshot Metrics(){
+                        return metrics_.Snapshot();
+                }
+                void ResetMetrics(){
+                        metrics_.Reset();
+                }
+
+                /*
+                 * Every call of a transform since the last ResetTrace(), as
+                 * Chrome trace event JSON, with the depth of the value and
+                 * the number of values it emitted. Each thread keeps the
+                 * last events of it's own, see SetTraceCapacity(). Needs
+                 * F_Trace, and CANDY_TRANSFORM_TRACE, see Trace.h. Not during
+                 * an execution
+                 */
+                void WriteTrace(std::ostream& ostr){
+                        trace_.WriteChrome(ostr);
+                }
+                void ResetTrace(){
+                        trace_.Reset();
+                }
+                void SetTraceCapacity(size_t events){
+                        trace_.SetCapacity(events);
+                }
+
+                /*
+                 * Errors from transforms, and type errors of continuations
+                 * they declared, of every execution so far
+                 */
+                ErrorLog Errors(){
+                        std::lock_guard<std::mutex> lock(errors_mtx_);
+                        return errors_;
+                }
+                void ResetErrors(){
+                        std::lock_guard<std::mutex> lock(errors_mtx_);
+                        errors_ = ErrorLog{};
+                }
+
+                /*
+                 * Type errors of the graph, for executing from values of
+                 * type In. Execution throws these, all at once
+                 */
+                template<class In>
+                std::vector<std::string> Validate(){
+                        return TypeErrors(*Freeze(), boost::typeindex::type_id<In>());
+                }
+
+                /*
+                 * Number of frontier items kept in memory. Past this the
+                 * coldest items, the shallowest, are spilled to a file in
+                 * dir, or the temporary directory, and reloaded once the rest
+                 * of the frontier is exhausted. Only values of a Serializable
+                 * type can be spilled, the others stay in memory. 0 for no
+                 * limit
+                 */
+                void SetFrontierBudget(size_t items, std::string const& dir = std::string{}){
+                        frontier_budget_ = items;
+                        spill_dir_ = dir;
+                }
+                /*
+                 * Order sequential executions expand the frontier in. Depth
+                 * first keeps the frontier smallest, breadth first gives
+                 * the shallowest results first, and iterative deepening goes
+                 * depth first, a deepening_step at a time. ExecuteParallel()
+                 * is always depth first per worker.
+                 *
+                 * Values fused down a chain with F_FuseChains skip the
+                 * frontier, and so it's order, so fusing is only done depth
+                 * first, and without a budget, see SetFrontierBudget()
+                 */
+                void SetFrontierPolicy(FrontierPolicy policy, FrontierOrder order = FO_Lifo, size_t deepening_step = 1){
+                        frontier_policy_ = policy;
+                        frontier_order_ = order;
+                        deepening_step_ = deepening_step;
+                }
+                /*
+                 * score(T const&) -> double of values of type T, for
+                 * FP_BestFirst, the least is expanded first. Values of other
+                 * types score 0
+                 */
+                template<class T, class Score>
+                void SetFrontierScore(Score score){
+                        scores_.emplace_back(typeid(T), [score](AnyType const& value)->double{
+                                return score(te::any_cast<T const&>(value));
+                        });
+                }
+                /*
+                 * size(T const&) -> size_t, the bytes of values of type T,
+                 * including what they own, for accounting the memory of
+                 * executions. The default handles std::string and
+                 * std::vector, and is sizeof(T) otherwise. Values of types
+                 * without one are counted as the box holding them
+                 */
+                template<class T, class Size>
+                void SetValueSize(Size size){
+                        sizes_.push_back(ValueSizer{typeid(T), [size](void const* value)->size_t{
+                                return size(*static_cast<T const*>(value));
+                        }});
+                }
+                template<class T>
+                void SetValueSize(){
+                        this->SetValueSize<T>(&DefaultValueSize<T>::Of);
+                }
+                /*
+                 * Bytes each execution can hold, in values in the frontier
+                 * and emitted but not yet routed, continuations declared,
+                 * results held, the transposition tables of Dedupe() and
+                 * Cache(), and the values folded by JP_Reduce joins, see
+                 * SetValueSize(). Past it the
+                 * execution throws MemoryBudgetExceeded, and under
+                 * ExecuteMany() only that execution fails. It's checked
+                 * after each expansion, so can be overshot by what one
+                 * expansion emits. 0 for no budget. Spilling with
+                 * SetFrontierBudget() keeps the frontier under it
+                 */
+                void SetMemoryBudget(size_t bytes){
+                        memory_budget_ = bytes;
+                }
+                /*
+                 * Largest peak of each category over the executions which
+                 * have finished since the last ResetPeakMemory(), with
+                 * F_Memory or a budget. ResultStream::Memory() is of one
+                 * execution as it runs
+                 */
+                MemoryUsage PeakMemory(){
+                        std::lock_guard<std::mutex> lock(memory_mtx_);
+                        return peak_memory_;
+                }
+                void ResetPeakMemory(){
+                        std::lock_guard<std::mutex> lock(memory_mtx_);
+                        peak_memory_ = MemoryUsage{};
+                }
+
+                /*
+                 * Allow values of type T to be written out of memory
+                 */
+                template<class T, class Write, class Read>
+                void Serializable(Write write, Read read){
+                        serializers_.push_back(ValueSerializer{typeid(T),
+                                [write](std::ostream& ostr, AnyType const& value){
+                                        write(ostr, te::any_cast<T const&>(value));
+                                },
+                                [read](std::istream& istr)->AnyType{
+                                        return AnyType{read(istr)};
+                                }});
+                }
+                template<class T>
+                void Serializable(){
+                        static_assert( DefaultSerializer<T>::Available, "no default serializer, pass a write and read function" );
+                        this->Serializable<T>(&DefaultSerializer<T>::Write, &DefaultSerializer<T>::Read);
+                }
+
+                /*
+                 * Drop values of type T which have already been seen at the
+                 * same node, before they're added to the frontier. Values are
+                 * compared by key(value), so a canonical form can be used,
+                 * ie sorting a multiset. With a capacity the table is
+                 * bounded, at the cost of sometimes expanding a duplicate
+                 */
+                template<class T, class KeyFn, class Hash, class Equal>
+                void Dedupe(KeyFn key, Hash hash, Equal equal, size_t capacity = 0){
+                        dedupe_.push_back(TranspositionFactory{typeid(T), [=](){
+                                return std::unique_ptr<TranspositionTable>(
+                                        new TranspositionTableImpl<T, KeyFn, Hash, Equal>(key, hash, equal, capacity));
+                        }});
+                }
+                template<class T, class KeyFn = DedupeIdentity>
+                void Dedupe(KeyFn key = KeyFn{}, size_t capacity = 0){
+                        using Key = std::decay_t<decltype(key(std::declval<T const&>()))>;
+                        this->Dedupe<T>(key, boost::hash<Key>{}, std::equal_to<Key>{}, capacity);
+                }
+
+                /*
+                 * Node where the paths of branches meet. The values of type T
+                 * reaching the end of any of the branches go on to what's
+                 * declared after the join, merged by policy
+                 *
+                 *     auto a = ctx.Start()->Next(...);
+                 *     auto b = ctx.Start()->Next(...);
+                 *     ctx.Join<std::string>({a, b})->Next(...);
+                 *
+                 * For JP_Reduce see JoinReduce(). The branches have to be
+                 * paths of this context
+                 */
+                template<class T>
+                std::shared_ptr<PathDecl> Join(std::vector<std::shared_ptr<PathDecl> > const& branches, JoinPolicy policy = JP_Union){
+                        if( policy == JP_Reduce )
+                                BOOST_THROW_EXCEPTION(std::invalid_argument("JP_Reduce needs a reducer, see JoinReduce()"));
+                        NodePolicy p;
+                        p.join = policy;
+                        return MakeJoin<T>(branches, std::move(p));
+                }
+                /*
+                 * Join whose values are folded with reduce(T acc, T value) -> T
+                 * as they arrive, and the result goes on once everything
+                 * which could reach the join has been expanded. Joins after
+                 * another are released after it
+                 */
+                template<class T, class Reduce>
+                std::shared_ptr<PathDecl> JoinReduce(std::vector<std::shared_ptr<PathDecl> > const& branches, Reduce reduce){
+                        NodePolicy p;
+                        p.join = JP_Reduce;
+                        p.reduce = [reduce](AnyType& acc, AnyType&& value){
+                                auto& a = te::any_cast<T&>(acc);
+                                a = reduce(std::move(a), std::move(te::any_cast<T&>(value)));
+                        };
+                        return MakeJoin<T>(branches, std::move(p));
+                }
+                /*
+                 * Values of type T reaching the end of at which are
+                 * equivalent, by key(value), to one which already reached
+                 * it during the execution are dropped, so that where paths
+                 * converge what follows is only evaluated once. Unlike
+                 * Dedupe(), only for the one node. With a capacity the table
+                 * is bounded, at the cost of sometimes evaluating what
+                 * follows again
+                 */
+                template<class T, class KeyFn = DedupeIdentity>
+                void Cache(std::shared_ptr<PathDecl> const& at, KeyFn key = KeyFn{}, size_t capacity = 0){
+                        using Key = std::decay_t<decltype(key(std::declval<T const&>()))>;
+                        auto node = NodeOf(at);
+                        std::unique_lock<std::shared_mutex> lock(G.Mutex());
+                        auto& p = policies_[node->Id()];
+                        p.node = node;
+                        p.cache = TranspositionFactory{typeid(T), [key, capacity](){
+                                return std::unique_ptr<TranspositionTable>(
+                                        new TranspositionTableImpl<T, KeyFn, boost::hash<Key>, std::equal_to<Key> >(key, {}, {}, capacity));
+                        }};
+                        // the graph hasn't changed, but the plan has
+                        plan_.reset();
+                }
+
+                /*
+                 * Every interval, a sequential execution writes it's
+                 * frontier, the continuations declared so far, the results
+                 * not yet pulled, and the count already delivered, to path,
+                 * and once more when it's done. It can be carried on from
+                 * there with Resume(), ie after a restart.
+                 *
+                 * Values are written with their Serializable() encoding,
+                 * including the results, and continuations declared with
+                 * DeclPath() with their SerializableTransform() encoding. The
+                 * graph of the context has to be the same when resuming.
+                 * The values folded so far by joins are kept, but
+                 * transposition tables and caches aren't, and
+                 * ExecuteParallel() doesn't checkpoint. An empty path turns
+                 * it off
+                 */
+                void SetCheckpoint(std::string const& path, std::chrono::milliseconds interval = std::chrono::minutes(1)){
+                        checkpoint_path_ = path;
+                        checkpoint_interval_ = interval;
+                }
+                /*
+                 * Allow continuations of type T to be written to a checkpoint,
+                 * the default for transforms which are default constructed
+                 */
+                template<class T, class Write, class Read>
+                void SerializableTransform(Write write, Read read){
+                        transform_serializers_.push_back(TransformSerializer{typeid(T),
+                                [write](std::ostream& ostr, TransformBase const& t){
+                                        write(ostr, static_cast<T const&>(t));
+                                },
+                                [read](std::istream& istr)->std::shared_ptr<TransformBase>{
+                                        return read(istr);
+                                }});
+                }
+                template<class T>
+                void SerializableTransform(){
+                        static_assert( std::is_default_constructible<T>::value, "not default constructible, pass a write and read function" );
+                        this->SerializableTransform<T>([](std::ostream&, T const&){}, [](std::istream&){
+                                return std::make_shared<T>();
+                        });
+                }
+
+                struct CheckpointFile{
+                        std::string path;
+                };
+
+                /*
+                 * Results of a sequential execution, produced as they're
+                 * pulled. The frontier is only expanded as far as is needed
+                 * for the next result, so a consumer can stop after the first
+                 * few results, or fold them as they arrive, and dropping the
+                 * stream ends the execution.
+                 *
+                 *     for(auto const& r : ctx.Stream<std::string>(241)){
+                 *         ...
+                 *     }
+                 *
+                 * Must not outlive the context
+                 */
+                template<class Out>
+                struct ResultStream{
+                        template<class In>
+                        ResultStream(TransformContext* ctx, In const& val)
+                                :ResultStream(ctx, val, ctx->Prepare(boost::typeindex::type_id<In>()), nullptr)
+                        {
+                                checkpoint_path_ = ctx_->checkpoint_path_;
+                        }
+                        /*
+                         * Of a prepared plan, borrowing the state of a
+                         * worker, and never checkpointed, see ExecuteMany()
+                         */
+                        template<class In>
+                        ResultStream(TransformContext* ctx, In const& val, std::shared_ptr<ExecutionPlan const> plan, WorkerState* worker)
+                                :ctx_(ctx),
+                                scope_(new ExecutionScope(plan, ctx->dedupe_)),
+                                own_( worker ? nullptr : new WorkerState(ctx) ),
+                                worker_( worker ? worker : own_.get() ),
+                                q_(ctx->MakeFrontier())
+                        {
+                                ctx_->AccountMemory(*scope_);
+                                q_.Push(StackItem{ctx_->head_, val, 0});
+                                if( Debug ){
+                                        std::cout << "ctx_->head_->OutEdges().size() => " << ctx_->head_->OutEdges().size() << "\n"; // __CandyPrint__(cxx-print-scalar,ctx_->head_->OutEdges().size())
+                                }
+                                next_checkpoint_ = std::chrono::steady_clock::now() + ctx_->checkpoint_interval_;
+                        }
+                        /*
+                         * Carries on from a checkpoint, see SetCheckpoint()
+                         */
+                        ResultStream(TransformContext* ctx, CheckpointFile const& file)
+                                :ctx_(ctx),
+                                own_(new WorkerState(ctx)),
+                                worker_(own_.get()),
+                                q_(ctx->MakeFrontier()),
+                                checkpoint_path_(ctx->checkpoint_path_)
+                        {
+                                auto plan = ctx_->Freeze();
+                                ctx_->ThrowTypeErrors(ctx_->TypeErrors(*plan, boost::none));
+                                scope_.reset(new ExecutionScope(plan, ctx_->dedupe_));
+                                ctx_->AccountMemory(*scope_);
+                                Load(file.path);
+                                next_checkpoint_ = std::chrono::steady_clock::now() + ctx_->checkpoint_interval_;
+                        }
+
+                        /*
+                         * Writes the state of the execution to path, to be
+                         * carried on with TransformContext::Resume(). Not
+                         * while calls are deferred
+                         */
+                        void Checkpoint(std::string const& path){
+                                if( scope_->Deferred().InFlight() )
+                                        BOOST_THROW_EXCEPTION(std::logic_error("can't checkpoint while calls are deferred"));
+                                auto tmp = path + ".tmp";
+                                {
+                                        std::ofstream ostr(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+                                        if( ! ostr )
+                                                BOOST_THROW_EXCEPTION(std::runtime_error("unable to write checkpoint " + tmp));
+                                        ctx_->WriteCheckpointHeader(ostr);
+                                        scope_->Save(ostr, [this](std::ostream& o, TransformBase const& t){
+                                                ctx_->WriteTransform(o, t);
+                                        }, [this](std::ostream& o, AnyType const& value){
+                                                ctx_->WriteValue(o, value);
+                                        });
+                                        DefaultSerializer<double>::Write(ostr, scope_->Bound());
+                                        DefaultSerializer<uint8_t>::Write(ostr, stopped_);
+                                        DefaultSerializer<uint64_t>::Write(ostr, delivered_);
+                                        DefaultSerializer<uint64_t>::Write(ostr, ready_.size());
+                                        for(auto const& _ : ready_){
+                                                ctx_->WriteValue(ostr, AnyType(_));
                                         }
-                                        t->ApplyImpl(&ctrl);
+                                        DefaultSerializer<uint64_t>::Write(ostr, q_.size() + ( spill_ ? spill_->size() : 0 ));
+                                        q_.ForEach([&](StackItem const& item){
+                                                ctx_->WriteItem(ostr, item);
+                                        });
+                                        if( spill_ ){
+                                                spill_->ForEach([&](StackItem&& item){
+                                                        ctx_->WriteItem(ostr, item);
+                                                });
+                                        }
+                                        ostr.flush();
+                                        if( ! ostr )
+                                                BOOST_THROW_EXCEPTION(std::runtime_error("unable to write checkpoint " + tmp));
+                                }
+                                std::filesystem::rename(tmp, path);
+                        }
+
+                        /*
+                         * Results pulled so far, including those pulled before
+                         * the checkpoint this was resumed from
+                         */
+                        uint64_t Delivered()const{ return delivered_; }
+
+                        /*
+                         * Bytes held by the execution so far, with F_Memory
+                         * or a budget, see SetMemoryBudget()
+                         */
+                        MemoryUsage Memory()const{
+                                auto memory = scope_->Memory();
+                                return memory ? memory->Usage() : MemoryUsage{};
+                        }
 
-                                        if( ctrl.return_ ){
-                                                if( flags_ & F_AggregateReturn ){
-                                                        result.push_back(te::any_cast<Out>(ctrl.return_.get()));
+                        /*
+                         * Next result, or none once the frontier is empty
+                         */
+                        boost::optional<Out> Next(){
+                                auto memory = scope_->Memory();
+                                auto push = [&](StackItem&& item){
+                                        q_.Push(std::move(item));
+                                };
+                                auto result = [&](AnyType&& value){
+                                        if( memory )
+                                                memory->Add(MC_Results, scope_->SizeOf(value));
+                                        ready_.push_back(std::move(te::any_cast<Out&>(value)));
+                                };
+                                auto release = [&](GNode* node, AnyType&& value, size_t depth){
+                                        push(StackItem{node, std::move(value), depth});
+                                };
+                                auto& deferred = scope_->Deferred();
+                                for(;ready_.empty() && ! stopped_;){
+                                        bool more;
+                                        if( deferred.Ready() ){
+                                                more = ctx_->Resume(*scope_, *worker_, push, result);
+                                        } else if( q_.empty() ){
+                                                if( spill_ && ! spill_->empty() ){
+                                                        spill_->Pop([&](StackItem&& item){
+                                                                ctx_->Track(*scope_, item);
+                                                                q_.Push(std::move(item));
+                                                        });
                                                         continue;
+                                                }
+                                                if( deferred.InFlight() == 0 ){
+                                                        // nothing else can reach the joins
+                                                        if( scope_->Flush([](){ return true; }, release) )
+                                                                continue;
+                                                        break;
+                                                }
+                                                deferred.Wait();
+                                                continue;
+                                        } else {
+                                                auto s = q_.Pop();
+
+                                                if( Debug ){
+                                                        std::cout << "q_.size() => " << q_.size() << "\n"; // __CandyPrint__(cxx-print-scalar,q_.size())
+                                                }
+
+                                                auto limit = ctx_->BatchLimit(*scope_, s.node);
+                                                if( limit > 1 ){
+                                                        // gather the items waiting on the same node
+                                                        batch_.clear();
+                                                        batch_.push_back(std::move(s));
+                                                        auto node = batch_.front().node;
+                                                        auto depth = batch_.front().depth;
+                                                        for(;batch_.size() < limit && q_.NextIs(node, depth);){
+                                                                batch_.push_back(q_.Pop());
+                                                        }
+                                                        more = ctx_->Expand(*scope_, *worker_, batch_.data(), batch_.size(), push, result);
                                                 } else {
-                                                        return std::vector<Out>{te::any_cast<Out>(ctrl.return_.get())};
+                                                        more = ctx_->Expand(*scope_, *worker_, std::move(s), push, result);
+                                                }
+                                        }
+                                        if( worker_->metrics ){
+                                                worker_->metrics->peak_frontier.Max(q_.size() + ( spill_ ? spill_->size() : 0 ));
+                                        }
+                                        if( ! more ){
+                                                // the first Return is the only result
+                                                stopped_ = true;
+                                                for(;ready_.size() > 1;){
+                                                        Drop(ready_.front());
+                                                        ready_.pop_front();
                                                 }
                                         }
 
-                                        GNode* n  = ( ctrl.M ? ctrl.M : e->To() );
-                                        for( auto const& _ : ctrl.E ){
-                                                q.push(StackItem{n, _, s.depth +1 });
+                                        auto budget = ctx_->frontier_budget_;
+                                        if( budget && q_.size() > std::max(budget, spill_at_) && ctx_->serializers_.size() ){
+                                                Spill(budget);
+                                        }
+                                        if( memory )
+                                                memory->Check();
+
+                                        // the clock is only read every so often
+                                        if( checkpoint_path_.size() && ++steps_ % CheckpointStride == 0 && deferred.InFlight() == 0 ){
+                                                auto now = std::chrono::steady_clock::now();
+                                                if( now >= next_checkpoint_ ){
+                                                        Checkpoint(checkpoint_path_);
+                                                        next_checkpoint_ = now + ctx_->checkpoint_interval_;
+                                                }
+                                        }
+                                }
+                                if( ready_.empty() ){
+                                        if( checkpoint_path_.size() && ! done_ ){
+                                                done_ = true;
+                                                Checkpoint(checkpoint_path_);
                                         }
+                                        return boost::none;
+                                }
+                                ++delivered_;
+                                // Execute() goes on holding them
+                                if( ! kept_ )
+                                        Drop(ready_.front());
+                                boost::optional<Out> next{std::move(ready_.front())};
+                                ready_.pop_front();
+                                return next;
+                        }
+
+                        struct iterator{
+                                using iterator_category = std::input_iterator_tag;
+                                using value_type = Out;
+                                using difference_type = std::ptrdiff_t;
+                                using pointer = Out*;
+                                using reference = Out&;
+
+                                Out& operator*()const{ return const_cast<Out&>(current_.get()); }
+                                Out* operator->()const{ return &**this; }
+                                iterator& operator++(){
+                                        current_ = stream_->Next();
+                                        return *this;
+                                }
+                                // end is when there's no current value
+                                bool operator==(iterator const& that)const{ return !! current_ == !! that.current_; }
+                                bool operator!=(iterator const& that)const{ return ! ( *this == that ); }
+
+                                ResultStream* stream_;
+                                boost::optional<Out> current_;
+                        };
+                        iterator begin(){ return iterator{this, Next()}; }
+                        iterator end(){ return iterator{this, boost::none}; }
+                private:
+                        friend struct TransformContext;
+                        enum{ CheckpointStride = 1024 };
+                        /*
+                         * A result no longer held by the execution
+                         */
+                        void Drop(Out const& value){
+                                if( auto memory = scope_->Memory() )
+                                        memory->Sub(MC_Results, scope_->SizeOf(typeid(Out), &value));
+                        }
+                        void Load(std::string const& path){
+                                std::ifstream istr(path, std::ios::in | std::ios::binary);
+                                if( ! istr )
+                                        BOOST_THROW_EXCEPTION(std::runtime_error("unable to read checkpoint " + path));
+                                ctx_->ReadCheckpointHeader(istr);
+                                scope_->Load(istr, ctx_->G, [this](std::istream& i){
+                                        return ctx_->ReadTransform(i);
+                                }, [this](std::istream& i){
+                                        return ctx_->ReadValue(i);
+                                });
+                                scope_->Publish(DefaultSerializer<double>::Read(istr));
+                                stopped_ = DefaultSerializer<uint8_t>::Read(istr);
+                                delivered_ = DefaultSerializer<uint64_t>::Read(istr);
+                                auto results = DefaultSerializer<uint64_t>::Read(istr);
+                                for(size_t idx=0;idx!=results && istr;++idx){
+                                        auto value = ctx_->ReadValue(istr);
+                                        if( auto memory = scope_->Memory() )
+                                                memory->Add(MC_Results, scope_->SizeOf(value));
+                                        ready_.push_back(std::move(te::any_cast<Out&>(value)));
+                                }
+                                auto items = DefaultSerializer<uint64_t>::Read(istr);
+                                for(size_t idx=0;idx!=items && istr;++idx){
+                                        auto item = ctx_->ReadItem(istr, *scope_);
+                                        ctx_->Track(*scope_, item);
+                                        q_.Push(std::move(item));
+                                }
+                                if( ! istr )
+                                        BOOST_THROW_EXCEPTION(std::runtime_error("checkpoint " + path + " is truncated"));
+                        }
+                        void Spill(size_t budget){
+                                if( ! spill_ )
+                                        spill_.reset(new SpillStack(ctx_->serializers_, ctx_->spill_dir_));
+                                // keep the half of the budget which is next
+                                auto keep = std::max<size_t>(1, budget / 2);
+                                auto cold = q_.TakeColdest(q_.size() - keep);
+                                SpillItems(cold, *spill_, keep, scope_->Memory());
+                                for(auto& _ : cold){
+                                        q_.Push(std::move(_));
+                                }
+                                // what's left can't be serialized, so don't go
+                                // over it again until the frontier doubles
+                                spill_at_ = ( q_.size() > budget ? 2 * q_.size() : 0 );
+                        }
+
+                        TransformContext* ctx_;
+                        std::unique_ptr<ExecutionScope> scope_;
+                        std::unique_ptr<WorkerState> own_;
+                        WorkerState* worker_;
+                        Frontier q_;
+                        std::deque<Out> ready_;
+                        std::vector<StackItem> batch_;
+                        std::unique_ptr<SpillStack> spill_;
+                        // frontier size to spill at once over the budget, see Spill()
+                        size_t spill_at_{0};
+                        bool stopped_{false};
+                        std::string checkpoint_path_;
+                        // results already pulled, see Delivered()
+                        uint64_t delivered_{0};
+                        size_t steps_{0};
+                        std::chrono::steady_clock::time_point next_checkpoint_;
+                        bool done_{false};
+                        // results pulled are still held, by Execute()
+                        bool kept_{false};
+                };
+
+                template<class Out, class In>
+                ResultStream<Out> Stream(In const& val){
+                        return ResultStream<Out>(this, val);
+                }
+
+                template<class Out, class In>
+                std::vector<Out> Execute(In const& val){
+                        auto stream = Stream<Out>(val);
+                        return Collect(stream);
+                }
+
+                /*
+                 * Results of an execution folded by reducer as they're
+                 * produced, rather than collected, so the memory doesn't
+                 * grow with the number of results
+                 *
+                 *     auto n = ctx.Reduce<std::string>(241, CountReducer{});
+                 */
+                template<class Out, class Reducer, class In>
+                auto Reduce(In const& val, Reducer reducer){
+                        auto stream = Stream<Out>(val);
+                        for(;;){
+                                auto r = stream.Next();
+                                if( ! r )
+                                        break;
+                                reducer.Add(std::move(r.get()));
+                        }
+                        return reducer.Result();
+                }
+
+                /*
+                 * Carries on an execution from the checkpoint at path,
+                 * written with SetCheckpoint(). The results pulled before
+                 * the checkpoint aren't produced again, only counted by
+                 * ResultStream::Delivered()
+                 */
+                template<class Out>
+                ResultStream<Out> ResumeStream(std::string const& path){
+                        return ResultStream<Out>(this, CheckpointFile{path});
+                }
+                template<class Out>
+                std::vector<Out> Resume(std::string const& path){
+                        auto stream = ResumeStream<Out>(path);
+                        return Collect(stream);
+                }
 
+                /*
+                 * Same as Execute, but the frontier is spread over a number of
+                 * worker threads. Each worker owns a deque, continuations are
+                 * pushed and popped from the back of the local deque (so each
+                 * worker goes depth first), and an idle worker steals from
+                 * the front of another workers deque, which is where the
+                 * largest subtrees are.
+                 *
+                 * The order of the result isn't defined, but the contents
+                 * are the same as Execute
+                 */
+                template<class Out, class In>
+                std::vector<Out> ExecuteParallel(In const& val, size_t threads = 0){
+                        return ReduceParallel<Out>(val, CollectReducer<Out>{}, threads);
+                }
+                /*
+                 * Reduce() over ExecuteParallel(), each worker folds into
+                 * it's own copy of reducer, and these are merged once the
+                 * execution is done
+                 */
+                template<class Out, class Reducer, class In>
+                auto ReduceParallel(In const& val, Reducer reducer, size_t threads = 0){
+                        if( threads == 0 )
+                                threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+                        ExecutionScope scope(Prepare(boost::typeindex::type_id<In>()), dedupe_);
+                        AccountMemory(scope);
+                        auto memory = scope.Memory();
+
+                        struct Worker{
+                                std::mutex mtx;
+                                std::deque<StackItem> dq;
+                                // only touched by the owner
+                                std::unique_ptr<SpillStack> spill;
+                                size_t spill_at{0};
+                                std::vector<StackItem> batch;
+                        };
+                        std::vector<Worker> workers(threads);
+                        workers[0].dq.push_back(StackItem{head_, val, 0});
+                        std::vector<Reducer> partial(threads, reducer);
+
+                        // number of items pushed, but not yet expanded
+                        std::atomic<size_t> pending{1};
+                        std::atomic<bool> stop{false};
+
+                        std::mutex err_mtx;
+                        std::exception_ptr err;
+                        // first Return when not aggregating
+                        boost::optional<Out> first;
+
+                        // the budget is split between the workers
+                        size_t budget = ( frontier_budget_ && serializers_.size() ? std::max<size_t>(2, frontier_budget_ / threads) : 0 );
+
+                        auto pop = [&](size_t idx)->boost::optional<StackItem>{
+                                {
+                                        auto& w = workers[idx];
+                                        std::lock_guard<std::mutex> lock(w.mtx);
+                                        if( w.dq.empty() && w.spill && ! w.spill->empty() ){
+                                                w.spill->Pop([&](StackItem&& item){
+                                                        Track(scope, item);
+                                                        w.dq.push_back(std::move(item));
+                                                });
+                                        }
+                                        if( w.dq.size() ){
+                                                StackItem s = std::move(w.dq.back());
+                                                w.dq.pop_back();
+                                                return s;
+                                        }
+                                }
+                                for(size_t offset=1;offset!=threads;++offset){
+                                        auto& v = workers[(idx + offset) % threads];
+                                        std::lock_guard<std::mutex> lock(v.mtx);
+                                        if( v.dq.size() ){
+                                                StackItem s = std::move(v.dq.front());
+                                                v.dq.pop_front();
+                                                return s;
+                                        }
+                                }
+                                return boost::none;
+                        };
+
+                        // spill the front of the deque, the shallowest items
+                        auto spill = [&](Worker& w){
+                                auto keep = budget / 2;
+                                std::vector<StackItem> cold;
+                                {
+                                        std::lock_guard<std::mutex> lock(w.mtx);
+                                        if( w.dq.size() <= std::max(budget, w.spill_at) )
+                                                return;
+                                        auto mid = w.dq.end() - keep;
+                                        cold.assign(std::make_move_iterator(w.dq.begin()), std::make_move_iterator(mid));
+                                        w.dq.erase(w.dq.begin(), mid);
+                                }
+                                if( ! w.spill )
+                                        w.spill.reset(new SpillStack(serializers_, spill_dir_));
+                                SpillItems(cold, *w.spill, keep, memory);
+                                std::lock_guard<std::mutex> lock(w.mtx);
+                                w.dq.insert(w.dq.begin(), std::make_move_iterator(cold.begin()), std::make_move_iterator(cold.end()));
+                                // as ResultStream::Spill(), back off from what can't be spilled
+                                w.spill_at = ( w.dq.size() > budget ? 2 * w.dq.size() : 0 );
+                        };
+
+                        auto run = [&](size_t idx){
+                                auto& w = workers[idx];
+                                WorkerState state(this);
+                                auto push = [&](StackItem&& item){
+                                        ++pending;
+                                        std::lock_guard<std::mutex> lock(w.mtx);
+                                        w.dq.push_back(std::move(item));
+                                };
+                                auto result = [&](AnyType&& value){
+                                        // only those a CollectReducer keeps are held
+                                        if( memory && KeepsResults<Reducer>::value )
+                                                memory->Add(MC_Results, scope.SizeOf(value));
+                                        auto& out = te::any_cast<Out&>(value);
+                                        if( flags_ & F_AggregateReturn ){
+                                                partial[idx].Add(std::move(out));
+                                                return;
+                                        }
+                                        // only from Return, and the first is the only result
+                                        std::lock_guard<std::mutex> lock(err_mtx);
+                                        if( ! first )
+                                                first = std::move(out);
+                                };
+                                auto release = [&](GNode* node, AnyType&& value, size_t depth){
+                                        push(StackItem{node, std::move(value), depth});
+                                };
+                                auto& deferred = scope.Deferred();
+                                auto quiescent = [&](){
+                                        return pending == 0 && deferred.InFlight() == 0;
+                                };
+                                try{
+                                        for(;! stop;){
+                                                bool more;
+                                                size_t count = 0;
+                                                if( deferred.Ready() ){
+                                                        more = Resume(scope, state, push, result);
+                                                } else {
+                                                        auto s = pop(idx);
+                                                        if( ! s ){
+                                                                if( quiescent() ){
+                                                                        if( scope.Flush(quiescent, release) )
+                                                                                continue;
+                                                                        break;
+                                                                }
+                                                                std::this_thread::yield();
+                                                                continue;
+                                                        }
+                                                        count = 1;
+                                                        auto limit = BatchLimit(scope, s->node);
+                                                        if( limit > 1 ){
+                                                                // gather the items waiting on the same node
+                                                                w.batch.clear();
+                                                                w.batch.push_back(std::move(s.get()));
+                                                                auto node = w.batch.front().node;
+                                                                auto depth = w.batch.front().depth;
+                                                                {
+                                                                        std::lock_guard<std::mutex> lock(w.mtx);
+                                                                        for(;w.dq.size() && w.batch.size() < limit && w.dq.back().node == node && w.dq.back().depth == depth;){
+                                                                                w.batch.push_back(std::move(w.dq.back()));
+                                                                                w.dq.pop_back();
+                                                                        }
+                                                                }
+                                                                count = w.batch.size();
+                                                                more = Expand(scope, state, w.batch.data(), count, push, result);
+                                                        } else {
+                                                                more = Expand(scope, state, std::move(s.get()), push, result);
+                                                        }
+                                                }
+                                                if( state.metrics ){
+                                                        state.metrics->peak_frontier.Max(pending);
+                                                }
+                                                if( ! more ){
+                                                        stop = true;
+                                                }
+                                                if( budget ){
+                                                        spill(w);
+                                                }
+                                                pending -= count;
+                                                if( memory )
+                                                        memory->Check();
+                                        }
+                                } catch(...){
+                                        std::lock_guard<std::mutex> lock(err_mtx);
+                                        if( ! err )
+                                                err = std::current_exception();
+                                        stop = true;
                                 }
+                        };
+
+                        std::vector<std::thread> pool;
+                        for(size_t idx=1;idx<threads;++idx){
+                                pool.emplace_back(run, idx);
+                        }
+                        run(0);
+                        for(auto& t : pool){
+                                t.join();
+                        }
+
+                        if( err )
+                                std::rethrow_exception(err);
+                        if( first ){
+                                reducer.Add(std::move(first.get()));
+                                return reducer.Result();
                         }
+                        for(size_t idx=1;idx<threads;++idx){
+                                partial[0].Merge(std::move(partial[idx]));
+                        }
+                        return partial[0].Result();
+                }
+
+                /*
+                 * Executes each of inputs on it's own, as Execute does, over
+                 * a number of threads. The executions share the compiled
+                 * graph, and each thread reuses it's worker state, so this
+                 * is for many small executions, where ExecuteParallel would
+                 * spend it's time stealing. The results are in the order of
+                 * the inputs. An execution over the memory budget is logged
+                 * to Errors() and left without results, rather than
+                 * stopping the rest, see SetMemoryBudget().
+                 *
+                 * Any number of executions can run against a context at
+                 * once, as everything an execution changes is it's own.
+                 * Extending the graph compiles a new plan for the executions
+                 * which start afterwards
+                 */
+                template<class Out, class Range>
+                std::vector<std::vector<Out> > ExecuteMany(Range const& inputs, size_t threads = 0){
+                        using In = std::decay_t<decltype(*std::begin(inputs))>;
+                        if( threads == 0 )
+                                threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+                        auto plan = Prepare(boost::typeindex::type_id<In>());
+                        std::vector<In const*> in;
+                        for(auto const& _ : inputs){
+                                in.push_back(&_);
+                        }
+                        std::vector<std::vector<Out> > result(in.size());
+                        threads = std::max<size_t>(1, std::min(threads, in.size()));
+
+                        std::atomic<size_t> next{0};
+                        std::atomic<bool> stop{false};
+                        std::mutex err_mtx;
+                        std::exception_ptr err;
+
+                        auto run = [&](){
+                                WorkerState state(this);
+                                try{
+                                        for(;! stop;){
+                                                auto idx = next++;
+                                                if( idx >= in.size() )
+                                                        break;
+                                                try{
+                                                        ResultStream<Out> stream(this, *in[idx], plan, &state);
+                                                        result[idx] = Collect(stream);
+                                                } catch(MemoryBudgetExceeded const& e){
+                                                        // the others carry on
+                                                        state.errors.Add("ExecuteMany", "input " + std::to_string(idx) + ": " + e.what());
+                                                }
+                                        }
+                                } catch(...){
+                                        std::lock_guard<std::mutex> lock(err_mtx);
+                                        if( ! err )
+                                                err = std::current_exception();
+                                        stop = true;
+                                }
+                        };
 
+                        std::vector<std::thread> pool;
+                        for(size_t idx=1;idx<threads;++idx){
+                                pool.emplace_back(run);
+                        }
+                        run();
+                        for(auto& t : pool){
+                                t.join();
+                        }
+                        if( err )
+                                std::rethrow_exception(err);
+                        return result;
+                }
+        private:
+                /*
+                 * Accounts the memory of an execution, with F_Memory or a
+                 * budget, and once it's over folds it into PeakMemory()
+                 */
+                void AccountMemory(ExecutionScope& scope){
+                        if( ! ( flags_ & F_Memory ) && memory_budget_ == 0 )
+                                return;
+                        scope.Account(&sizes_, std::unique_ptr<MemoryAccount>(new MemoryAccount(memory_budget_, [this](MemoryUsage const& usage){
+                                std::lock_guard<std::mutex> lock(memory_mtx_);
+                                peak_memory_.Merge(usage);
+                        })));
+                }
+                /*
+                 * Accounts item to the frontier of the execution, when it's
+                 * accounted
+                 */
+                static void Track(ExecutionScope& scope, StackItem& item){
+                        if( auto memory = scope.Memory() ){
+                                item.bytes = scope.SizeOf(*item.A);
+                                memory->Add(MC_Frontier, item.bytes);
+                        }
+                }
+                Frontier MakeFrontier()const{
+                        std::function<double(AnyType const&)> score;
+                        if( frontier_policy_ == FP_BestFirst ){
+                                score = [this](AnyType const& value)->double{
+                                        std::type_index type = te::typeid_of(value);
+                                        for(auto const& _ : scores_){
+                                                if( _.first == type )
+                                                        return _.second(value);
+                                        }
+                                        return 0;
+                                };
+                        }
+                        return Frontier(frontier_policy_, frontier_order_, deepening_step_, std::move(score));
+                }
+                GNode* NodeOf(std::shared_ptr<PathDecl> const& decl){
+                        auto ptr = dynamic_cast<GraphPathDecl const*>(decl.get());
+                        if( ! ptr || ptr->G != &G )
+                                BOOST_THROW_EXCEPTION(std::invalid_argument("not a path of this context"));
+                        return ptr->N;
+                }
+                template<class V>
+                std::shared_ptr<PathDecl> MakeJoin(std::vector<std::shared_ptr<PathDecl> > const& branches, NodePolicy p){
+                        std::vector<GNode*> from;
+                        for(auto const& _ : branches){
+                                from.push_back(NodeOf(_));
+                        }
+                        std::unique_lock<std::shared_mutex> lock(G.Mutex());
+                        auto join = G.Node("join");
+                        for(auto _ : from){
+                                T[G.Edge(_, join)] = std::make_shared<JoinTransform<V> >();
+                        }
+                        p.node = join;
+                        policies_[join->Id()] = std::move(p);
+                        return std::make_shared<GraphPathDecl>(&G, join, &T);
+                }
+                /*
+                 * Packs the graph and compiles the plan, once per change of
+                 * the graph
+                 */
+                std::shared_ptr<ExecutionPlan const> Freeze(){
+                        {
+                                std::shared_lock<std::shared_mutex> lock(G.Mutex());
+                                if( Current() )
+                                        return plan_;
+                        }
+                        std::unique_lock<std::shared_mutex> lock(G.Mutex());
+                        if( Current() )
+                                return plan_;
+                        G.Freeze();
+                        auto plan = std::make_shared<ExecutionPlan>();
+                        plan->node_count = G.NodeCount();
+                        plan->edge.assign(G.EdgeCount(), PlanEdge{});
+                        plan->batch_limit.assign(G.NodeCount(), 1);
+                        plan->chain.assign(G.NodeCount(), nullptr);
+                        for(size_t idx=0;idx!=G.NodeCount();++idx){
+                                plan->chain[idx] = ChainEdge(G.NodeAt(idx), [this](GEdge const* e){ return T.Color(e).get(); });
+                        }
+                        for(size_t idx=0;idx!=G.EdgeCount();++idx){
+                                auto e = G.EdgeAt(idx);
+                                auto t = T.Color(e).get();
+                                // type errors are thrown rather than checked
+                                plan->edge[idx] = PlanEdge{t, false};
+                                auto& limit = plan->batch_limit[e->From()->Id()];
+                                limit = std::max(limit, t->BatchSize());
+                                for(auto f : e->To()->OutEdges()){
+                                        auto err = EdgeTypeError(*t, *T.Color(f));
+                                        if( err )
+                                                plan->type_errors.push_back(err.get());
+                                }
+                        }
+                        plan->out_offset = G.OutCsr().offset;
+                        plan->out_edge = G.OutCsr().ptr;
+                        if( policies_.size() ){
+                                plan->policy.assign(G.NodeCount(), nullptr);
+                                for(auto const& p : policies_){
+                                        auto q = std::make_shared<NodePolicy>(p.second);
+                                        q->slot = plan->policies.size();
+                                        plan->policy[p.first] = q.get();
+                                        plan->policies.push_back(q);
+                                }
+                                for(auto id : TopologicalOrder()){
+                                        auto q = plan->policy[id];
+                                        if( q && q->join == JP_Reduce )
+                                                plan->reducers.push_back(q->slot);
+                                }
+                        }
+                        plan_ = plan;
+                        return plan_;
+                }
+                /*
+                 * Ids of the nodes, each after every node with a path to it
+                 */
+                std::vector<size_t> TopologicalOrder()const{
+                        auto const& out = G.OutCsr();
+                        std::vector<size_t> in(G.NodeCount());
+                        for(auto _ : out.node){
+                                ++in[_];
+                        }
+                        std::vector<size_t> order;
+                        for(size_t idx=0;idx!=in.size();++idx){
+                                if( in[idx] == 0 )
+                                        order.push_back(idx);
+                        }
+                        for(size_t k=0;k!=order.size();++k){
+                                auto id = order[k];
+                                for(auto pos=out.offset[id];pos!=out.offset[id+1];++pos){
+                                        if( --in[out.node[pos]] == 0 )
+                                                order.push_back(out.node[pos]);
+                                }
+                        }
+                        return order;
+                }
+                bool Current()const{
+                        return plan_ && G.Frozen() && plan_->edge.size() == G.EdgeCount() && plan_->node_count == G.NodeCount();
+                }
+                /*
+                 * Without in, the edges out of the head aren't checked
+                 */
+                std::vector<std::string> TypeErrors(ExecutionPlan const& plan, boost::optional<boost::typeindex::type_index> in)const{
+                        auto errors = plan.type_errors;
+                        if( ! in )
+                                return errors;
+                        for(auto e : plan.OutEdges(head_)){
+                                auto t = plan.edge[e->Id()].transform;
+                                if( t->GetInType() != in.get() ){
+                                        errors.push_back(t->Name() + " takes " + t->GetInType().pretty_name() +
+                                                         ", but is executed from " + in->pretty_name());
+                                }
+                        }
+                        return errors;
+                }
+                /*
+                 * Compiles the plan, and throws every type error at once
+                 */
+                std::shared_ptr<ExecutionPlan const> Prepare(boost::typeindex::type_index in){
+                        auto plan = Freeze();
+                        ThrowTypeErrors(TypeErrors(*plan, in));
+                        return plan;
+                }
+                static void ThrowTypeErrors(std::vector<std::string> const& errors){
+                        if( errors.size() ){
+                                std::stringstream sstr;
+                                sstr << "graph has " << errors.size() << " type error(s)";
+                                for(auto const& _ : errors){
+                                        sstr << "\n    " << _;
+                                }
+                                BOOST_THROW_EXCEPTION(std::domain_error(sstr.str()));
+                        }
+                }
+                template<class Out>
+                static std::vector<Out> Collect(ResultStream<Out>& stream){
+                        stream.kept_ = true;
+                        std::vector<Out> result;
+                        for(;;){
+                                auto r = stream.Next();
+                                if( ! r )
+                                        break;
+                                result.push_back(std::move(r.get()));
+                        }
                         return result;
                 }
+                /*
+                 * A checkpoint starts with the shape of the graph it's of,
+                 * which is checked when it's read back
+                 */
+                enum{ CheckpointMagic = 0x4b435443, CheckpointVersion = 3 };
+                void WriteCheckpointHeader(std::ostream& ostr){
+                        std::shared_lock<std::shared_mutex> lock(G.Mutex());
+                        DefaultSerializer<uint32_t>::Write(ostr, CheckpointMagic);
+                        DefaultSerializer<uint32_t>::Write(ostr, CheckpointVersion);
+                        DefaultSerializer<uint64_t>::Write(ostr, G.NodeCount());
+                        DefaultSerializer<uint64_t>::Write(ostr, G.EdgeCount());
+                        for(size_t idx=0;idx!=G.EdgeCount();++idx){
+                                auto e = G.EdgeAt(idx);
+                                DefaultSerializer<uint64_t>::Write(ostr, e->From()->Id());
+                                DefaultSerializer<uint64_t>::Write(ostr, e->To()->Id());
+                                DefaultSerializer<std::string>::Write(ostr, T.Color(e)->Name());
+                        }
+                }
+                void ReadCheckpointHeader(std::istream& istr){
+                        std::shared_lock<std::shared_mutex> lock(G.Mutex());
+                        if( DefaultSerializer<uint32_t>::Read(istr) != CheckpointMagic || DefaultSerializer<uint32_t>::Read(istr) != CheckpointVersion )
+                                BOOST_THROW_EXCEPTION(std::runtime_error("not a checkpoint"));
+                        bool same = DefaultSerializer<uint64_t>::Read(istr) == G.NodeCount();
+                        auto edges = DefaultSerializer<uint64_t>::Read(istr);
+                        same = same && edges == G.EdgeCount();
+                        for(size_t idx=0;idx!=edges && istr;++idx){
+                                auto from = DefaultSerializer<uint64_t>::Read(istr);
+                                auto to = DefaultSerializer<uint64_t>::Read(istr);
+                                auto name = DefaultSerializer<std::string>::Read(istr);
+                                if( ! same )
+                                        continue;
+                                auto e = G.EdgeAt(idx);
+                                same = e->From()->Id() == from && e->To()->Id() == to && T.Color(e)->Name() == name;
+                        }
+                        if( ! same || ! istr )
+                                BOOST_THROW_EXCEPTION(std::domain_error("checkpoint is of a different graph"));
+                }
+                void WriteValue(std::ostream& ostr, AnyType const& value)const{
+                        std::type_index type = te::typeid_of(value);
+                        for(size_t idx=0;idx!=serializers_.size();++idx){
+                                if( serializers_[idx].type == type ){
+                                        DefaultSerializer<uint32_t>::Write(ostr, static_cast<uint32_t>(idx));
+                                        serializers_[idx].write(ostr, value);
+                                        return;
+                                }
+                        }
+                        BOOST_THROW_EXCEPTION(std::domain_error("can't checkpoint values of type " +
+                                boost::typeindex::type_index(te::typeid_of(value)).pretty_name() + ", see Serializable()"));
+                }
+                AnyType ReadValue(std::istream& istr)const{
+                        auto idx = DefaultSerializer<uint32_t>::Read(istr);
+                        if( idx >= serializers_.size() )
+                                BOOST_THROW_EXCEPTION(std::runtime_error("checkpoint has an unknown value type"));
+                        return serializers_[idx].read(istr);
+                }
+                void WriteTransform(std::ostream& ostr, TransformBase const& t)const{
+                        std::type_index type = typeid(t);
+                        for(size_t idx=0;idx!=transform_serializers_.size();++idx){
+                                if( transform_serializers_[idx].type == type ){
+                                        DefaultSerializer<uint32_t>::Write(ostr, static_cast<uint32_t>(idx));
+                                        transform_serializers_[idx].write(ostr, t);
+                                        return;
+                                }
+                        }
+                        BOOST_THROW_EXCEPTION(std::domain_error("can't checkpoint continuation " + t.Name() + ", see SerializableTransform()"));
+                }
+                std::shared_ptr<TransformBase> ReadTransform(std::istream& istr)const{
+                        auto idx = DefaultSerializer<uint32_t>::Read(istr);
+                        if( idx >= transform_serializers_.size() )
+                                BOOST_THROW_EXCEPTION(std::runtime_error("checkpoint has an unknown continuation"));
+                        return transform_serializers_[idx].read(istr);
+                }
+                void WriteItem(std::ostream& ostr, StackItem const& item)const{
+                        DefaultSerializer<uint64_t>::Write(ostr, item.node->Id());
+                        DefaultSerializer<uint64_t>::Write(ostr, item.depth);
+                        DefaultSerializer<double>::Write(ostr, item.bound);
+                        WriteValue(ostr, *item.A);
+                }
+                StackItem ReadItem(std::istream& istr, ExecutionScope& scope){
+                        auto id = DefaultSerializer<uint64_t>::Read(istr);
+                        auto depth = DefaultSerializer<uint64_t>::Read(istr);
+                        auto bound = DefaultSerializer<double>::Read(istr);
+                        auto node = ( id < scope.Plan().node_count ? G.NodeAt(id) : scope.NodeAt(id) );
+                        return StackItem{node, ValuePool::Box(new AnyType(ReadValue(istr))), depth, bound};
+                }
+                /*
+                 * Transform colouring an edge, either of the context graph,
+                 * which isn't changed during an execution, or of the scope,
+                 * whose ids follow on
+                 */
+                PlanEdge TransformOf(ExecutionScope& scope, GEdge const* e)const{
+                        auto const& plan = scope.Plan();
+                        if( e->Id() < plan.edge.size() )
+                                return plan.edge[e->Id()];
+                        return scope.Color(e);
+                }
+                /*
+                 * Whether values go down chains without the frontier, only
+                 * when that's the order the frontier would take them in
+                 */
+                bool Fusing()const{
+                        return ( flags_ & F_FuseChains ) && frontier_policy_ == FP_DepthFirst && frontier_budget_ == 0;
+                }
+                /*
+                 * The out edge of node when it has one in edge and one out
+                 * edge, so values reaching it can be fused with the next
+                 * transform. Not for batching transforms, as their batches
+                 * are gathered in the frontier
+                 */
+                template<class Transform_>
+                static GEdge* ChainEdge(GNode const* node, Transform_&& transform){
+                        if( node->InEdges().size() != 1 || node->OutEdges().size() != 1 )
+                                return nullptr;
+                        auto e = node->OutEdges().front();
+                        if( transform(e)->BatchSize() > 1 )
+                                return nullptr;
+                        return e;
+                }
+                GEdge* ChainOf(ExecutionScope& scope, GNode const* node)const{
+                        auto const& plan = scope.Plan();
+                        if( node->Id() < plan.chain.size() )
+                                return plan.chain[node->Id()];
+                        return ChainEdge(node, [&](GEdge const* e){ return TransformOf(scope, e).transform; });
+                }
+                /*
+                 * Largest batch any out edge of node will take
+                 */
+                size_t BatchLimit(ExecutionScope& scope, GNode const* node)const{
+                        auto const& plan = scope.Plan();
+                        if( node->Id() < plan.batch_limit.size() )
+                                return plan.batch_limit[node->Id()];
+                        return scope.BatchLimit(node);
+                }
+                /*
+                 * Expand items of the frontier, this is the body of the
+                 * execution loop, shared by the sequential and parallel
+                 * executors. The items all have the same node and depth.
+                 *
+                 *     push(StackItem&&)          continuation of the path
+                 *     result(AnyType&&)          terminal or Return value
+                 *
+                 * Each item is applied to each out edge, or when the
+                 * transform takes batches, the items are applied together.
+                 * The arguments are copied for each out edge, except the last
+                 * which consumes them
+                 *
+                 * returns false when the execution should stop, ie on the
+                 * first Return when not aggregating
+                 */
+                template<class Push, class Result>
+                bool Expand(ExecutionScope& scope, WorkerState& worker, StackItem* first, size_t count, Push&& push, Result&& result){
+                        auto node = first->node;
+                        auto depth = first->depth;
+                        if( Debug ){
+                                std::cout << "scope.OutEdges(node).size() => " << scope.OutEdges(node).size() << "\n"; // __CandyPrint__(cxx-print-scalar,scope.OutEdges(node).size())
+                                std::cout << "*first => " << *first << "\n"; // __CandyPrint__(cxx-print-scalar,*first)
+                        }
+
+                        if( auto memory = scope.Memory() ){
+                                for(size_t idx=0;idx!=count;++idx){
+                                        memory->Sub(MC_Frontier, first[idx].bytes);
+                                        first[idx].bytes = 0;
+                                }
+                        }
+
+                        // drop what can no longer beat the incumbent
+                        auto kept = std::remove_if(first, first + count, [&](StackItem const& s){
+                                return scope.Prunable(s.bound);
+                        });
+                        if( worker.metrics )
+                                worker.metrics->pruned.Add(first + count - kept);
+                        count = kept - first;
+                        if( count == 0 )
+                                return true;
+
+                        auto out = scope.OutEdges(node);
+                        if( out.empty() ){
+                                if( flags_ & F_AggregateReturn ){
+                                        for(size_t idx=0;idx!=count;++idx){
+                                                result(std::move(*first[idx].A));
+                                                worker.pool->Recycle(std::move(first[idx].A));
+                                        }
+                                }
+                                return true;
+                        }
+
+                        auto& pool = *worker.pool;
+                        size_t idx = 0;
+                        for( auto e : out ){
+                                ++idx;
+                                bool last = ( idx == out.size() );
+                                auto pe = TransformOf(scope, e);
+                                auto t = pe.transform;
+
+                                if( Debug ){
+                                        std::cout << "t->Name() => " << t->Name() << "\n"; // __CandyPrint__(cxx-print-scalar,t->Name())
+                                }
+
+                                if( count > 1 && t->BatchSize() > 1 ){
+                                        for(size_t offset=0;offset<count;offset+=t->BatchSize()){
+                                                auto n = std::min(count - offset, t->BatchSize());
+                                                // assigned into, so the slots are reused
+                                                auto& args = worker.args;
+                                                if( args.size() < n )
+                                                        args.resize(n);
+                                                for(size_t k=0;k!=n;++k){
+                                                        if( last ){
+                                                                args[k] = std::move(*first[offset+k].A);
+                                                                pool.Recycle(std::move(first[offset+k].A));
+                                                        } else {
+                                                                args[k] = *first[offset+k].A;
+                                                        }
+                                                }
+                                                auto& ctrl = worker.Level(worker.level);
+                                                // what isn't of an Item() is bounded by the loosest
+                                                double bound = std::numeric_limits<double>::infinity();
+                                                for(size_t k=0;k!=n;++k){
+                                                        bound = std::min(bound, first[offset+k].bound);
+                                                }
+                                                ctrl.Reset(&scope, e, depth, bound);
+                                                ctrl.batch_ = Span<AnyType>(args.data(), n);
+                                                for(size_t k=0;k!=n;++k){
+                                                        ctrl.batch_bounds_.push_back(first[offset+k].bound);
+                                                }
+                                                Invoke(worker, pe, ctrl, n);
+                                                if( ! Finish(scope, worker, e, ctrl, depth, push, result) )
+                                                        return false;
+                                        }
+                                        continue;
+                                }
+
+                                for(size_t k=0;k!=count;++k){
+                                        auto& ctrl = worker.Level(worker.level);
+                                        ctrl.Reset(&scope, e, depth, first[k].bound);
+                                        if( last ){
+                                                ctrl.A = std::move(*first[k].A);
+                                                pool.Recycle(std::move(first[k].A));
+                                        } else {
+                                                ctrl.A = *first[k].A;
+                                        }
+                                        Invoke(worker, pe, ctrl, 0);
+                                        if( ! Finish(scope, worker, e, ctrl, depth, push, result) )
+                                                return false;
+                                }
+                        }
+                        return true;
+                }
+                template<class Push, class Result>
+                bool Expand(ExecutionScope& scope, WorkerState& worker, StackItem&& s, Push&& push, Result&& result){
+                        return Expand(scope, worker, &s, 1, push, result);
+                }
+                /*
+                 * Routes a deferred call which has been released, see
+                 * TransformControl::Defer(). The call was counted when it
+                 * was applied, other than what it emitted since
+                 */
+                template<class Push, class Result>
+                bool Resume(ExecutionScope& scope, WorkerState& worker, Push&& push, Result&& result){
+                        auto call = scope.Deferred().Take();
+                        if( ! call )
+                                return true;
+                        struct DoneGuard{
+                                ~DoneGuard(){ queue.Done(); }
+                                DeferredQueue& queue;
+                        } guard{scope.Deferred()};
+                        auto& ctrl = static_cast<DeferredControl&>(*call);
+                        auto t = TransformOf(scope, ctrl.edge_).transform;
+                        LogErrors(worker, t, ctrl);
+                        if( worker.metrics ){
+                                auto& c = CountersOf(*worker.metrics, t, ctrl);
+                                c.emits.Add(ctrl.E.size());
+                                c.errors.Add(ctrl.errors_.size());
+                                c.returns.Add(ctrl.Returns());
+                        }
+                        return Finish(scope, worker, ctrl.edge_, ctrl, ctrl.depth_, push, result);
+                }
+                /*
+                 * ApplyImpl, or ApplyBatchImpl for n > 0, unchecked when the
+                 * edge was validated. Counted when metrics are on, and errors
+                 * are logged
+                 */
+                void Invoke(WorkerState& worker, PlanEdge const& pe, Control& ctrl, size_t n){
+                        auto t = pe.transform;
+                        bool trace = Tracing && worker.trace;
+                        if( ! worker.metrics && ! trace ){
+                                Apply(pe, ctrl, n);
+                                LogErrors(worker, t, ctrl);
+                                return;
+                        }
+                        auto start = std::chrono::steady_clock::now();
+                        Apply(pe, ctrl, n);
+                        auto stop = std::chrono::steady_clock::now();
+                        LogErrors(worker, t, ctrl);
+                        if( trace )
+                                worker.trace->Record(t->Name(), trace_.Since(start), trace_.Since(stop), ctrl.depth_, ctrl.E.size());
+                        if( ! worker.metrics )
+                                return;
+                        auto& c = CountersOf(*worker.metrics, t, ctrl);
+                        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+                        c.calls.Add(1);
+                        c.items.Add( n ? n : 1 );
+                        c.emits.Add(ctrl.E.size());
+                        c.errors.Add(ctrl.errors_.size());
+                        c.returns.Add(ctrl.Returns());
+                        c.nanos.Add(nanos);
+                        c.latency[LatencyBucket(nanos)].Add(1);
+                }
+                /*
+                 * Counters of t, the transform of ctrl. Continuations
+                 * declared during an execution are freed with it, so are
+                 * counted by name rather than by address
+                 */
+                static TransformCounters& CountersOf(MetricsShard& shard, TransformBase* t, Control const& ctrl){
+                        if( ctrl.edge_->Id() < ctrl.scope_->Plan().edge.size() )
+                                return shard.Get(t, t->Name());
+                        return shard.GetByName(t->Name());
+                }
+                void Apply(PlanEdge const& pe, Control& ctrl, size_t n){
+                        bool checked = pe.checked || ( flags_ & F_CheckTypes );
+                        if( n ){
+                                if( checked ){
+                                        pe.transform->ApplyBatchImpl(&ctrl, n);
+                                } else {
+                                        pe.transform->ApplyBatchUnchecked(&ctrl, n);
+                                }
+                        } else {
+                                if( checked ){
+                                        pe.transform->ApplyImpl(&ctrl);
+                                } else {
+                                        pe.transform->ApplyUnchecked(&ctrl);
+                                }
+                        }
+                }
+                static void LogErrors(WorkerState& worker, TransformBase* t, Control const& ctrl){
+                        for(auto const& _ : ctrl.errors_){
+                                worker.errors.Add(t->Name(), _);
+                        }
+                }
+                /*
+                 * Once a transform has returned, route what it emitted
+                 */
+                template<class Push, class Result>
+                bool Finish(ExecutionScope& scope, WorkerState& worker, GEdge const* e, Control& ctrl, size_t depth, Push&& push, Result&& result){
+                        if( ctrl.itemised_ )
+                                ctrl.EndItem();
+
+                        if( ctrl.segments_.empty() )
+                                return Route(scope, worker, e, ctrl, 0, ctrl.E.size(), ctrl.bound_, ctrl.return_, ctrl.declared_, depth, push, result);
+                        // each item of the batch on it's own
+                        for(auto& seg : ctrl.segments_){
+                                ctrl.decl_.decl.swap(seg.decl);
+                                if( ! Route(scope, worker, e, ctrl, seg.begin, seg.end, seg.bound, seg.return_, seg.declared, depth, push, result) ){
+                                        ctrl.ReleaseAll();
+                                        return false;
+                                }
+                        }
+                        return true;
+                }
+                /*
+                 * Routes E[begin, end) of ctrl, emitted from an argument of
+                 * bound, or what was returned in place of them
+                 */
+                template<class Push, class Result>
+                bool Route(ExecutionScope& scope, WorkerState& worker, GEdge const* e, Control& ctrl, size_t begin, size_t end, double arg_bound,
+                           boost::optional<AnyType>& returned, bool declared, size_t depth, Push&& push, Result&& result){
+                        if( returned ){
+                                for(size_t idx=begin;idx!=end;++idx){
+                                        ctrl.Release(idx);
+                                }
+                                result(std::move(returned.get()));
+                                return ( flags_ & F_AggregateReturn ) != 0;
+                        }
+
+                        GNode* n  = ( declared ? scope.Intern(e, *TransformOf(scope, e).transform, ctrl.decl_, worker.errors) : e->To() );
+                        for(size_t idx=begin;idx!=end;++idx){
+                                auto bytes = ctrl.Release(idx);
+                                auto bound = ctrl.BoundOf(idx, arg_bound);
+                                if( scope.Prunable(bound) ){
+                                        if( worker.metrics )
+                                                worker.metrics->pruned.Add(1);
+                                        continue;
+                                }
+                                if( scope.Seen(n, *ctrl.E[idx]) )
+                                        continue;
+                                if( ! scope.Arrive(n, *ctrl.E[idx], depth + 1) )
+                                        continue;
+                                if( Fusing() && worker.level + 1 < MaxFusion ){
+                                        if( auto next = ChainOf(scope, n) ){
+                                                if( ! Fuse(scope, worker, next, std::move(ctrl.E[idx]), depth + 1, bound, push, result) ){
+                                                        ctrl.ReleaseAll();
+                                                        return false;
+                                                }
+                                                continue;
+                                        }
+                                }
+                                StackItem item{n, std::move(ctrl.E[idx]), depth +1, bound};
+                                if( bytes ){
+                                        item.bytes = bytes;
+                                        scope.Memory()->Add(MC_Frontier, bytes);
+                                }
+                                push(std::move(item));
+                        }
+                        return true;
+                }
+                /*
+                 * Applies the transform of e, the only out edge of the node
+                 * the value reached, straight away on the next level of
+                 * Control, rather than pushing the value to the frontier and
+                 * popping it again. Chains longer than MaxFusion go through
+                 * the frontier every MaxFusion stages
+                 */
+                enum{ MaxFusion = 64 };
+                template<class Push, class Result>
+                bool Fuse(ExecutionScope& scope, WorkerState& worker, GEdge const* e, ValuePool::Box value, size_t depth, double bound, Push&& push, Result&& result){
+                        struct LevelGuard{
+                                explicit LevelGuard(size_t& level):level_(level){ ++level_; }
+                                ~LevelGuard(){ --level_; }
+                                size_t& level_;
+                        };
+                        LevelGuard guard(worker.level);
+                        auto& ctrl = worker.Level(worker.level);
+                        ctrl.Reset(&scope, e, depth, bound);
+                        ctrl.A = std::move(*value);
+                        worker.pool->Recycle(std::move(value));
+                        Invoke(worker, TransformOf(scope, e), ctrl, 0);
+                        return Finish(scope, worker, e, ctrl, depth, push, result);
+                }
+
         private:
                 Graph G;
                 GNode* head_;
                 GraphColouring<std::shared_ptr<TransformBase> > T;
+                std::shared_ptr<ExecutionPlan const> plan_;
+                std::mutex errors_mtx_;
+                ErrorLog errors_;
+                std::vector<TranspositionFactory> dedupe_;
+                // by node id, see Join() and Cache()
+                std::map<size_t, NodePolicy> policies_;
+                std::vector<ValueSerializer> serializers_;
+                std::vector<TransformSerializer> transform_serializers_;
+                std::string checkpoint_path_;
+                std::chrono::milliseconds checkpoint_interval_{0};
+                size_t frontier_budget_{0};
+                std::string spill_dir_;
+                FrontierPolicy frontier_policy_{FP_DepthFirst};
+                FrontierOrder frontier_order_{FO_Lifo};
+                size_t deepening_step_{1};
+                std::vector<std::pair<std::type_index, std::function<double(AnyType const&)> > > scores_;
+                TransformMetrics metrics_;
+                TraceLog trace_;
+                std::vector<ValueSizer> sizes_;
+                size_t memory_budget_{0};
+                std::mutex memory_mtx_;
+                MemoryUsage peak_memory_;
                 size_t counter_{0};
         };
 